@@ -0,0 +1,172 @@
+#include "analysis.h"
+
+#include <algorithm>
+#include <climits>
+
+
+PatternAnalysis::PatternAnalysis(const vector<RegexOperator *> &regex) :
+    minLength(0), maxLength(0) {
+
+    // Each operator consumes exactly one character per repetition, so the
+    // match lengths are just the sums of the repeat counts.
+    for (const RegexOperator *op : regex) {
+        minLength += op->getMinRepeat();
+        if (maxLength != -1 && op->getMaxRepeat() != -1)
+            maxLength += op->getMaxRepeat();
+        else
+            maxLength = -1;
+    }
+
+    // The first character of a non-empty match is consumed by some operator
+    // that every operator before it was allowed to skip, so it comes from
+    // one of the operators up to and including the first required one.
+    for (const RegexOperator *op : regex) {
+        firstChars.add(op->getMatchingChars());
+        if (op->getMinRepeat() > 0)
+            break;
+    }
+
+    finish();
+}
+
+
+/* The facts about one node of a syntax tree.  The lengths are long enough
+ * not to overflow while they are combined, and are clamped to INT_MAX;
+ * maxLength is -1 if it is unbounded.
+ */
+struct NodeFacts {
+    long long minLength, maxLength;
+    CharSet firstChars;
+};
+
+
+static long long clampLength(long long length) {
+    return min(length, (long long) INT_MAX);
+}
+
+
+static NodeFacts analyze(const SyntaxNode &node) {
+    NodeFacts facts{0, 0, CharSet()};
+
+    switch (node.kind) {
+    case SyntaxNode::CHARS:
+        facts.minLength = facts.maxLength = 1;
+        facts.firstChars = node.chars;
+        break;
+
+    case SyntaxNode::CONCAT: {
+        // The first character comes from the children up to and including
+        // the first one that can't match the empty string.
+        bool skippable = true;
+        for (const unique_ptr<SyntaxNode> &child : node.children) {
+            NodeFacts sub = analyze(*child);
+            if (skippable)
+                facts.firstChars.add(sub.firstChars);
+            skippable = skippable && sub.minLength == 0;
+
+            facts.minLength = clampLength(facts.minLength + sub.minLength);
+            if (facts.maxLength != -1 && sub.maxLength != -1)
+                facts.maxLength = clampLength(facts.maxLength + sub.maxLength);
+            else
+                facts.maxLength = -1;
+        }
+        break;
+    }
+
+    case SyntaxNode::ALTERNATE:
+        facts.minLength = INT_MAX;
+        for (const unique_ptr<SyntaxNode> &child : node.children) {
+            NodeFacts sub = analyze(*child);
+            facts.firstChars.add(sub.firstChars);
+            facts.minLength = min(facts.minLength, sub.minLength);
+            if (facts.maxLength != -1 && sub.maxLength != -1)
+                facts.maxLength = max(facts.maxLength, sub.maxLength);
+            else
+                facts.maxLength = -1;
+        }
+        break;
+
+    case SyntaxNode::REPEAT: {
+        if (node.maxRepeat == 0)
+            break;
+
+        NodeFacts sub = analyze(*node.children[0]);
+        facts.firstChars = sub.firstChars;
+        facts.minLength = clampLength(sub.minLength * node.minRepeat);
+        if (sub.maxLength == 0)
+            facts.maxLength = 0;
+        else if (sub.maxLength != -1 && node.maxRepeat != -1)
+            facts.maxLength = clampLength(sub.maxLength * node.maxRepeat);
+        else
+            facts.maxLength = -1;
+        break;
+    }
+    }
+
+    return facts;
+}
+
+
+/* A maximum length that reaches INT_MAX is treated as unbounded, since it
+ * may have been clamped.
+ */
+PatternAnalysis::PatternAnalysis(const SyntaxNode &syntax) {
+    NodeFacts facts = analyze(syntax);
+    minLength = (int) facts.minLength;
+    maxLength = facts.maxLength >= INT_MAX ? -1 : (int) facts.maxLength;
+    firstChars = facts.firstChars;
+
+    finish();
+}
+
+
+/* Work out the characters that can't start a match, once the others are
+ * known.
+ */
+void PatternAnalysis::finish() {
+    notFirstChars = firstChars.complement();
+    filtersFirstChar = firstChars.count() < 256;
+}
+
+
+int PatternAnalysis::getMinLength() const {
+    return minLength;
+}
+
+
+int PatternAnalysis::getMaxLength() const {
+    return maxLength;
+}
+
+
+const CharSet & PatternAnalysis::getFirstChars() const {
+    return firstChars;
+}
+
+
+int PatternAnalysis::nextStart(string_view s, int from) const {
+    // A non-empty match needs at least one character, and at least
+    // minLength of them.
+    int last = (int) s.length() - max(minLength, 1);
+    if (from > last)
+        return -1;
+
+    if (filtersFirstChar) {
+        const char *begin = s.data();
+        from = (int) (findFirstNonMember(notFirstChars, begin + from,
+                                         begin + last + 1) - begin);
+        if (from > last)
+            return -1;
+    }
+    return from;
+}
+
+
+bool PatternAnalysis::canMatch(string_view s) const {
+    int length = (int) s.length();
+    if (length == 0 || length < minLength)
+        return false;
+    if (maxLength != -1 && length > maxLength)
+        return false;
+    return firstChars.contains((unsigned char) s[0]);
+}
@@ -0,0 +1,46 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "syntax.h"
+
+
+/* Facts about a regex that hold for every match, worked out once from the
+ * operators or the syntax tree: the shortest and longest strings it can
+ * match, and the characters a non-empty match can start with.  find() uses
+ * them to skip indexes where no match can start, and match() uses them to
+ * reject strings without running an engine at all.
+ */
+class PatternAnalysis {
+    // The length of the shortest and longest match.  The maximum is -1 if
+    // it is unbounded.
+    int minLength, maxLength;
+
+    // The characters that can be the first character of a non-empty match,
+    // and the characters that can't
+    CharSet firstChars;
+    CharSet notFirstChars;
+
+    // False if every character can start a match, so that looking for one
+    // is a waste of time
+    bool filtersFirstChar;
+
+    void finish();
+
+public:
+    PatternAnalysis(const vector<RegexOperator *> &regex);
+    PatternAnalysis(const SyntaxNode &syntax);
+
+    int getMinLength() const;
+    int getMaxLength() const;
+    const CharSet & getFirstChars() const;
+
+    // Returns the first index at or after from where a non-empty match
+    // could start, or -1 if there isn't one.
+    int nextStart(string_view s, int from) const;
+
+    // Returns false if the regex can't possibly match the entire string.
+    bool canMatch(string_view s) const;
+};
+
+
+#endif // ANALYSIS_H
@@ -0,0 +1,210 @@
+#include "approx.h"
+
+#include <stdexcept>
+
+
+ApproxSearcher::ApproxSearcher(const vector<RegexOperator *> &regex) {
+    if (regex.size() > MAX_OPERATORS)
+        throw invalid_argument("too many operators for approximate matching");
+    for (const RegexOperator *op : regex) {
+        int min = op->getMinRepeat(), max = op->getMaxRepeat();
+        if ((min != 0 && min != 1) || (max != 1 && max != -1))
+            throw invalid_argument("unsupported repeat count");
+    }
+
+    compile(forward, regex, false);
+    compile(reverse, regex, true);
+}
+
+
+/* Fill in the masks for the operators, in reverse order if reversed is
+ * true.  Operator i is bit i + 1.
+ */
+void ApproxSearcher::compile(Automaton &automaton,
+                             const vector<RegexOperator *> &regex,
+                             bool reversed) {
+    automaton = Automaton();
+
+    int n = (int) regex.size();
+    for (int i = 0; i < n; i++) {
+        const RegexOperator *op = regex[reversed ? n - 1 - i : i];
+        uint64_t bit = (uint64_t) 1 << (i + 1);
+
+        CharSet chars = op->getMatchingChars();
+        for (int c = 0; c < 256; c++) {
+            if (chars.contains((unsigned char) c))
+                automaton.accepts[c] |= bit;
+        }
+
+        if (op->getMaxRepeat() != 1)
+            automaton.repeatable |= bit;
+        if (op->getMinRepeat() == 0)
+            automaton.optional |= bit;
+    }
+
+    // Working back from the last operator, each state is final until an
+    // operator that can't be skipped, or the state before them all.
+    for (int i = n; i >= 0; i--) {
+        automaton.final |= (uint64_t) 1 << i;
+        if (i == 0 || (automaton.optional >> i & 1) == 0)
+            break;
+    }
+}
+
+
+/* Returns every state that could consume the next character after the
+ * states: the operators after them, carried through any run of optional
+ * operators as in the Shift-And engine, and the repeated operators they
+ * are already on.
+ */
+static inline uint64_t follow(uint64_t repeatable, uint64_t optional,
+                              uint64_t states) {
+    uint64_t next = states << 1;
+    next |= (optional + (next & optional)) ^ optional;
+    return next | (states & repeatable);
+}
+
+
+/* Set the states a match starts in, for each number of errors: the state
+ * before any operator, and the states reached by deleting operators from
+ * the start of the regex.
+ */
+void ApproxSearcher::startStates(const Automaton &automaton,
+                                 uint64_t *states, int maxErrors) {
+    states[0] = 1;
+    for (int j = 1; j <= maxErrors; j++) {
+        states[j] = states[j - 1] |
+            follow(automaton.repeatable, automaton.optional, states[j - 1]);
+    }
+}
+
+
+/* Advance the states for each number of errors over the character, and
+ * return the fewest errors with which a match now ends, or -1 if none
+ * does.  If start isn't null, the states a match starts in are added
+ * afterward, so that another match can start after the character.
+ */
+static inline int advance(const uint64_t accepts[256], uint64_t repeatable,
+                          uint64_t optional, uint64_t final,
+                          uint64_t *states, const uint64_t *start,
+                          int maxErrors, unsigned char c) {
+    // The states with one error fewer, before and after the character
+    uint64_t before = 0, after = 0;
+    int fewest = -1;
+
+#ifdef __GNUC__
+#pragma GCC unroll 4
+#endif
+    for (int j = 0; j <= maxErrors; j++) {
+        uint64_t old = states[j];
+        uint64_t next = follow(repeatable, optional, old) & accepts[c];
+        if (j > 0) {
+            // Insertions stay in place, substitutions move on from before
+            // the character, and deletions move on from after it.
+            next |= after | before |
+                follow(repeatable, optional, before | after);
+        }
+
+        if (fewest == -1 && (next & final) != 0)
+            fewest = j;
+
+        before = old;
+        after = next;
+        states[j] = start ? next | start[j] : next;
+    }
+    return fewest;
+}
+
+
+/* Does the work of find().  When Errors isn't -1, it is the number of
+ * errors, known at compile time, so that the loop over the states is
+ * unrolled and the states stay in registers rather than memory.
+ */
+template <int Errors>
+ApproxMatch ApproxSearcher::find(string_view s, int maxErrors,
+                                 int from) const {
+    constexpr int FIXED = Errors >= 0 ? Errors + 1 : 1;
+    uint64_t fixedStart[FIXED], fixedStates[FIXED];
+    vector<uint64_t> anyStart, anyStates;
+
+    uint64_t *start = fixedStart, *states = fixedStates;
+    if (Errors >= 0) {
+        maxErrors = Errors;
+    }
+    else {
+        anyStart.resize(maxErrors + 1);
+        anyStates.resize(maxErrors + 1);
+        start = anyStart.data();
+        states = anyStates.data();
+    }
+
+    // Scan forward for where the match ends.  A match may start at every
+    // index, so the start states are added back after each character.
+    const Automaton &f = forward;
+    startStates(f, start, maxErrors);
+    for (int j = 0; j <= maxErrors; j++)
+        states[j] = start[j];
+
+    int end = -1, errors = -1;
+    for (int i = from; i < (int) s.length(); i++) {
+        int fewest = advance(f.accepts, f.repeatable, f.optional, f.final,
+                             states, start, maxErrors, (unsigned char) s[i]);
+        if (end != -1 && (fewest == -1 || fewest > errors))
+            break;
+        if (fewest != -1) {
+            end = i + 1;
+            errors = fewest;
+        }
+    }
+    if (end == -1)
+        return ApproxMatch{-1, -1, -1};
+
+    // Scan backward from the end over the reversed regex, with only as many
+    // errors as the match needs, for the leftmost index it can start at.
+    const Automaton &r = reverse;
+    vector<uint64_t> backward(errors + 1);
+    startStates(r, backward.data(), errors);
+
+    int matchStart = end - 1;
+    for (int i = end - 1; i >= from; i--) {
+        if (advance(r.accepts, r.repeatable, r.optional, r.final,
+                    backward.data(), nullptr, errors,
+                    (unsigned char) s[i]) != -1)
+            matchStart = i;
+        if (backward[errors] == 0)
+            break;
+    }
+
+    return ApproxMatch{matchStart, end, errors};
+}
+
+
+ApproxMatch ApproxSearcher::find(string_view s, int maxErrors,
+                                 int from) const {
+    if (maxErrors < 0)
+        throw invalid_argument("the number of errors can't be negative");
+    if (from >= (int) s.length())
+        return ApproxMatch{-1, -1, -1};
+
+    switch (maxErrors) {
+    case 0:
+        return find<0>(s, maxErrors, from);
+    case 1:
+        return find<1>(s, maxErrors, from);
+    case 2:
+        return find<2>(s, maxErrors, from);
+    case 3:
+        return find<3>(s, maxErrors, from);
+    default:
+        return find<-1>(s, maxErrors, from);
+    }
+}
+
+
+ApproxMatch findApprox(const Regex &regex, string_view s, int maxErrors) {
+    if (regex.getSyntax() != nullptr)
+        throw invalid_argument("groups and alternation are unsupported");
+
+    ApproxSearcher searcher(regex.getOperators());
+    return searcher.find(s, maxErrors);
+}
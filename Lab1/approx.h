@@ -0,0 +1,84 @@
+#ifndef APPROX_H
+#define APPROX_H
+
+#include "matcher.h"
+
+#include <cstdint>
+
+
+/* An approximate match: the range of the text it covers, and the number of
+ * insertions, deletions and substitutions needed to turn that text into a
+ * string the regex matches.  All three are -1 if there is no match.
+ */
+struct ApproxMatch {
+    int start, end;
+    int errors;
+};
+
+
+/* Finds matches of a regex that are within a bounded edit distance, with the
+ * bit-parallel algorithm of Wu and Manber, run over the regex's Glushkov
+ * automaton.
+ *
+ * As in the Shift-And engine, each operator is one bit of a machine word,
+ * meaning "the last character was consumed by this operator", and bit 0 is
+ * the state before any operator.  There is one word of states for each
+ * number of errors from 0 to the maximum.  For each character, the states
+ * with j errors are the ones that consume it with j errors, plus the ones
+ * with j - 1 errors that:
+ *
+ *   - stay where they are, inserting the character into the match;
+ *   - move on to any operator that could come next, substituting the
+ *     character for the one the operator wanted;
+ *   - after the character, move on without consuming anything, deleting an
+ *     operator from the match.
+ *
+ * So each character costs O(k) word operations for k errors.
+ */
+class ApproxSearcher {
+public:
+    // One bit is taken by the state before any operator.
+    static constexpr int MAX_OPERATORS = 63;
+
+private:
+    struct Automaton {
+        uint64_t accepts[256];
+        uint64_t repeatable;
+        uint64_t optional;
+        uint64_t final;
+    };
+
+    Automaton forward, reverse;
+
+    static void compile(Automaton &automaton,
+                        const vector<RegexOperator *> &regex, bool reversed);
+    static void startStates(const Automaton &automaton, uint64_t *states,
+                            int maxErrors);
+
+    template <int Errors>
+    ApproxMatch find(string_view s, int maxErrors, int from) const;
+
+public:
+    // Throws invalid_argument if there are more than MAX_OPERATORS
+    // operators, or one isn't repeated once, ?, * or +.
+    ApproxSearcher(const vector<RegexOperator *> &regex);
+
+    // Find the first approximate match with at most maxErrors errors that
+    // starts at or after from.  The match ends at the first index where a
+    // non-empty match with few enough errors ends, or later, for as long as
+    // ending one character later needs no more errors.  It starts at the
+    // leftmost index from which a match ending there has the fewest errors.
+    // Throws invalid_argument if maxErrors is negative.
+    ApproxMatch find(string_view s, int maxErrors, int from = 0) const;
+};
+
+
+/* Find the first match of the regex in the string with at most maxErrors
+ * insertions, deletions or substitutions.  This compiles the regex for a
+ * single search; to search many strings, use an ApproxSearcher.  Throws
+ * invalid_argument if the regex has groups or alternation.
+ */
+ApproxMatch findApprox(const Regex &regex, string_view s, int maxErrors);
+
+
+#endif // APPROX_H
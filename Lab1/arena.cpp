@@ -0,0 +1,41 @@
+#include "arena.h"
+
+#include <cassert>
+
+
+RegexArena::RegexArena() : block(nullptr), capacity(0), used(0) {
+    // Nothing else to do.
+}
+
+
+RegexArena::~RegexArena() {
+    ::operator delete(block);
+}
+
+
+/* Allocate a block of the specified size, discarding everything already in
+ * the arena.
+ */
+void RegexArena::reset(size_t bytes) {
+    ::operator delete(block);
+    block = nullptr;
+    capacity = 0;
+    if (bytes != 0)
+        block = (char *) ::operator new(bytes);
+    capacity = bytes;
+    used = 0;
+}
+
+
+/* Returns uninitialized memory for an object from the block. */
+void * RegexArena::allocate(size_t size, size_t alignment) {
+    size_t start = (used + alignment - 1) / alignment * alignment;
+    assert(start + size <= capacity);
+    used = start + size;
+    return block + start;
+}
+
+
+size_t RegexArena::getUsed() const {
+    return used;
+}
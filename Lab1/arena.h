@@ -0,0 +1,58 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+
+/* A bump allocator over one contiguous block of memory, used to hold all the
+ * operators of a parsed regex.  Creating an object just advances a pointer,
+ * and the whole block is released with a single free when the arena is
+ * destroyed.
+ *
+ * Destructors of the objects in the arena are never run, so it may only hold
+ * objects whose destructors don't need to do anything.
+ */
+class RegexArena {
+    char *block;
+    size_t capacity;
+    size_t used;
+
+public:
+    RegexArena();
+    ~RegexArena();
+
+    RegexArena(const RegexArena &other) = delete;
+    RegexArena & operator=(const RegexArena &other) = delete;
+
+    // Allocate a block of the specified size, discarding everything already
+    // in the arena.
+    void reset(size_t bytes);
+
+    // Returns uninitialized memory for an object from the block.  The block
+    // must have room for it.
+    void * allocate(size_t size, size_t alignment);
+
+    template <typename T, typename... Args>
+    T * create(Args &&... args) {
+        return new (allocate(sizeof(T), alignof(T)))
+            T(std::forward<Args>(args)...);
+    }
+
+    // The number of bytes handed out so far
+    size_t getUsed() const;
+};
+
+
+/* Returns the space that an object of type T takes up in an arena, when it
+ * follows other objects aligned at most as strictly.
+ */
+template <typename T>
+constexpr size_t arenaSize() {
+    return (sizeof(T) + alignof(max_align_t) - 1)
+        / alignof(max_align_t) * alignof(max_align_t);
+}
+
+
+#endif // ARENA_H
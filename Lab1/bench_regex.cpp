@@ -0,0 +1,725 @@
+#include "approx.h"
+#include "cache.h"
+#include "engine.h"
+#include "matcher.h"
+#include "parallel.h"
+#include "regexset.h"
+#include "static_regex.h"
+#include "stream.h"
+#include "teddy.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+
+
+using namespace std;
+
+
+/*===========================================================================
+ * HELPERS
+ */
+
+
+/* Generate a log-like buffer of pseudo-random words, with a match for the
+ * benchmark patterns planted only at the very end.
+ */
+static string makeHaystack(int length) {
+    mt19937 rng(4321);
+    const string alphabet = "abcdefghijklmnopqrstuvwxyz";
+    string s;
+    s.reserve(length + 16);
+    while ((int) s.length() < length) {
+        int word = 1 + rng() % 10;
+        for (int i = 0; i < word; i++)
+            s += alphabet[rng() % alphabet.length()];
+        s += ' ';
+    }
+    s += "abegjkk";
+    return s;
+}
+
+
+/* Returns the number of seconds since some arbitrary point in time. */
+static double now() {
+    using namespace chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+
+/* Run the function repeatedly for about a quarter of a second, and return
+ * the average number of nanoseconds per byte of the input it searches.
+ */
+template <typename F>
+static double nsPerByte(size_t inputLength, F f) {
+    int iterations = 0;
+    double start = now(), elapsed;
+    do {
+        f();
+        iterations++;
+        elapsed = now() - start;
+    } while (elapsed < 0.25);
+
+    return elapsed * 1e9 / ((double) inputLength * iterations);
+}
+
+
+/* Print one line of benchmark results. */
+static void report(const string &label, double nsPerByte) {
+    cout << "  " << left << setw(40) << label << right << fixed
+         << setprecision(3) << setw(8) << nsPerByte << " ns/byte" << endl;
+}
+
+
+/*===========================================================================
+ * BENCHMARKS
+ *
+ * These are called by the main() function at the end of this file.
+ */
+
+
+/*! Compare the backtracking engine running over the operators with the same
+ *  algorithm running over the compiled bytecode.
+ */
+void bench_bytecode() {
+    const vector<string> patterns = {
+        "ab+c?d*[ef]+g[^ghi]*j.+k", "[aeiou]+[xyz]+Q", "e[^ ]+Z"
+    };
+    const string haystack = makeHaystack(1 << 18);
+
+    cout << "Backtracking engine, " << haystack.length() << " byte buffer"
+         << endl;
+
+    for (const string &pattern : patterns) {
+        const Regex regex(pattern);
+        BacktrackContext context;
+        Matcher matcher(regex, Engine::BACKTRACK);
+
+        report("operators:  " + pattern, nsPerByte(haystack.length(), [&]() {
+            findBacktrack(regex.getOperators(), haystack, context);
+        }));
+        report("bytecode:   " + pattern, nsPerByte(haystack.length(), [&]() {
+            matcher.find(haystack);
+        }));
+    }
+    cout << endl;
+}
+
+
+/*! Compare scanning a long run of a character class one character at a time
+ *  with the vectorized scan over the class bitmap.
+ */
+void bench_char_classes() {
+    const Regex regex(
+        "[abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_ ]+");
+    const string haystack = makeHaystack(1 << 20);
+
+    cout << "Character class run, " << haystack.length() << " byte buffer"
+         << endl;
+
+    BacktrackContext context;
+    Matcher matcher(regex, Engine::BACKTRACK);
+
+    report("operators", nsPerByte(haystack.length(), [&]() {
+        findAtIndex(regex.getOperators(), haystack, 0, context);
+    }));
+    report("bitmap + SIMD", nsPerByte(haystack.length(), [&]() {
+        matcher.findAtIndex(haystack, 0);
+    }));
+    cout << endl;
+}
+
+
+/*! Measure the operator backtracker on patterns that repeat over the whole
+ *  buffer and then have to give it all back.
+ */
+void bench_repetition_runs() {
+    const vector<string> patterns = {".*Q", "[^Q]+Q", "[abcdefghijklmnopqrstuvwxyz ]*Q"};
+    const string haystack = makeHaystack(1 << 24);
+
+    cout << "Operator backtracker, long runs, " << haystack.length()
+         << " byte buffer" << endl;
+
+    for (const string &pattern : patterns) {
+        const Regex regex(pattern);
+        BacktrackContext context;
+
+        report(pattern, nsPerByte(haystack.length(), [&]() {
+            findAtIndex(regex.getOperators(), haystack, 0, context);
+        }));
+    }
+    cout << endl;
+}
+
+
+/*! Measure throughput when many threads share one compiled regex. */
+void bench_shared_regex() {
+    const Regex regex("ab+c?d*[ef]+g[^ghi]*j.+k");
+    const string haystack = makeHaystack(1 << 20);
+    const int searchesPerThread = 20;
+
+    cout << "Shared regex, DFA engine, " << haystack.length()
+         << " byte buffer" << endl;
+
+    int maxThreads = max(1, (int) thread::hardware_concurrency());
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+        double start = now();
+
+        vector<thread> threads;
+        for (int t = 0; t < numThreads; t++) {
+            threads.emplace_back([&]() {
+                Matcher matcher(regex, Engine::DFA);
+                for (int i = 0; i < searchesPerThread; i++)
+                    matcher.find(haystack);
+            });
+        }
+        for (thread &t : threads)
+            t.join();
+
+        double elapsed = now() - start;
+        double bytes = (double) haystack.length() * searchesPerThread
+            * numThreads;
+        cout << "  " << setw(3) << numThreads << " thread(s): "
+             << fixed << setprecision(1) << bytes / elapsed / 1e6 << " MB/s"
+             << endl;
+    }
+    cout << endl;
+}
+
+
+/*! Compare the generic engines with the literal engine on plain-string
+ *  patterns.  The generic engines still get to use the literal prefilter.
+ */
+void bench_literal() {
+    const vector<string> patterns = {
+        "abegjkk", "quickbrownfoxjumpsoverthelazydog"
+    };
+    string haystack = makeHaystack(1 << 23);
+    haystack += patterns[1];
+
+    cout << "Plain-string patterns, " << haystack.length() << " byte buffer"
+         << endl;
+
+    for (const string &pattern : patterns) {
+        const Regex regex(pattern);
+        Matcher backtrack(regex, Engine::BACKTRACK);
+        Matcher dfa(regex, Engine::DFA);
+        Matcher literal(regex, Engine::LITERAL);
+
+        report("backtrack:  " + pattern, nsPerByte(haystack.length(), [&]() {
+            backtrack.find(haystack);
+        }));
+        report("DFA:        " + pattern, nsPerByte(haystack.length(), [&]() {
+            dfa.find(haystack);
+        }));
+        report("literal:    " + pattern, nsPerByte(haystack.length(), [&]() {
+            literal.find(haystack);
+        }));
+        report("Horspool:   " + pattern, nsPerByte(haystack.length(), [&]() {
+            regex.getLiteralSearcher().findHorspool(haystack);
+        }));
+    }
+    cout << endl;
+}
+
+
+/*! Compare compiling a pattern for every search with looking it up in the
+ *  regex cache.
+ */
+void bench_regex_cache() {
+    const string pattern = "ab+c?d*[ef]+g[^ghi]*j.+k";
+    const string line = "the quick brown fox abbbcddeeegxxjzzk";
+    RegexCache cache;
+
+    cout << "Regex cache, one " << line.length() << " byte line per lookup"
+         << endl;
+
+    report("parseRegex + find + clearRegex", nsPerByte(line.length(), [&]() {
+        vector<RegexOperator *> regex = parseRegex(pattern);
+        find(regex, line);
+        clearRegex(regex);
+    }));
+    report("cache lookup + find", nsPerByte(line.length(), [&]() {
+        RegexCache::Handle regex = cache.get(pattern);
+        Matcher(*regex).find(line);
+    }));
+    report("cache lookup + backtracking find", nsPerByte(line.length(), [&]() {
+        RegexCache::Handle regex = cache.get(pattern);
+        Matcher(*regex, Engine::BACKTRACK).find(line);
+    }));
+    cout << endl;
+}
+
+
+/*! Compare finding every match by searching copies of the rest of the
+ *  buffer with iterating over findAll().
+ */
+void bench_find_all() {
+    const Regex regex("q[aeiou]+[^ ]*");
+    const string haystack = makeHaystack(1 << 20);
+    Matcher matcher(regex);
+
+    cout << "Every match of " << "q[aeiou]+[^ ]*" << ", " << haystack.length()
+         << " byte buffer" << endl;
+
+    report("find() on substr() copies", nsPerByte(haystack.length(), [&]() {
+        size_t offset = 0;
+        for (;;) {
+            Range r = matcher.find(haystack.substr(offset));
+            if (r.start == -1)
+                break;
+            offset += r.end;
+        }
+    }));
+    report("findAll()", nsPerByte(haystack.length(), [&]() {
+        for (const Range &r : matcher.findAll(haystack))
+            (void) r;
+    }));
+    cout << endl;
+}
+
+
+/*! Compare findAll() over a whole buffer with streaming the same buffer
+ *  through a StreamMatcher in pipe-sized chunks.
+ */
+void bench_stream() {
+    const Regex regex("q[aeiou]+[^ ]*");
+    const string haystack = makeHaystack(1 << 20);
+    Matcher matcher(regex);
+
+    cout << "Every match of " << "q[aeiou]+[^ ]*" << ", " << haystack.length()
+         << " byte buffer" << endl;
+
+    report("findAll(), whole buffer", nsPerByte(haystack.length(), [&]() {
+        for (const Range &r : matcher.findAll(haystack))
+            (void) r;
+    }));
+
+    long matches = 0;
+    StreamMatcher stream(regex, [&](const StreamMatch &) { matches++; });
+    report("StreamMatcher, 4 KB chunks", nsPerByte(haystack.length(), [&]() {
+        for (size_t i = 0; i < haystack.length(); i += 4096)
+            stream.feed(string_view(haystack).substr(i, 4096));
+        stream.finish();
+    }));
+    cout << endl;
+}
+
+
+/*! Compare the serial search of a large buffer with searching its parts on
+ *  every core.
+ */
+void bench_parallel() {
+    const Regex regex("q[aeiou]+z?");
+    const Regex last("abeg.kk");
+    const string haystack = makeHaystack(1 << 26);
+    int numThreads = max(1u, thread::hardware_concurrency());
+
+    cout << "Count q[aeiou]+z? and find abeg.kk, " << haystack.length()
+         << " byte buffer, " << numThreads << " threads" << endl;
+
+    report("count, 1 thread", nsPerByte(haystack.length(), [&]() {
+        parallelCount(regex, haystack, 1);
+    }));
+    report("count, every thread", nsPerByte(haystack.length(), [&]() {
+        parallelCount(regex, haystack, numThreads);
+    }));
+    report("find, 1 thread", nsPerByte(haystack.length(), [&]() {
+        parallelFind(last, haystack, 1);
+    }));
+    report("find, every thread", nsPerByte(haystack.length(), [&]() {
+        parallelFind(last, haystack, numThreads);
+    }));
+    cout << endl;
+}
+
+
+/*! Compare matching a column of short strings one std::string at a time
+ *  with matching the whole column in one batch.
+ */
+void bench_batch() {
+    const Regex regex("[aeiou]+[^aeiou]?e");
+    const string haystack = makeHaystack(1 << 22);
+    int numThreads = max(1u, thread::hardware_concurrency());
+
+    // Every word of the haystack is one string of the column.
+    string data;
+    vector<int64_t> offsets{0};
+    for (size_t i = 0; i < haystack.length(); ) {
+        size_t end = haystack.find(' ', i);
+        if (end == string::npos)
+            end = haystack.length();
+        data.append(haystack, i, end - i);
+        offsets.push_back((int64_t) data.length());
+        i = end + 1;
+    }
+    StringColumn column{data.data(), offsets.data(), offsets.size() - 1};
+
+    cout << "Match " << "[aeiou]+[^aeiou]?e" << " against " << column.size
+         << " strings" << endl;
+
+    report("match() on each std::string", nsPerByte(data.length(), [&]() {
+        for (size_t i = 0; i < column.size; i++)
+            match(regex.getOperators(), string(column[i]));
+    }));
+    report("batchMatch(), 1 thread", nsPerByte(data.length(), [&]() {
+        batchMatch(regex, column, 1);
+    }));
+    report("batchMatch(), every thread", nsPerByte(data.length(), [&]() {
+        batchMatch(regex, column, numThreads);
+    }));
+    cout << endl;
+}
+
+
+/*! Compare checking lines against each of many regexes in turn with
+ *  checking them against a RegexSet, for growing numbers of regexes.
+ */
+void bench_regex_set() {
+    const string haystack = makeHaystack(1 << 18);
+    vector<string_view> lines;
+    for (size_t i = 0; i < haystack.length(); i += 80)
+        lines.push_back(string_view(haystack).substr(i, 80));
+
+    mt19937 rng(99);
+    auto letter = [&]() { return (char) ('a' + rng() % 26); };
+
+    for (int numPatterns : {10, 100, 500}) {
+        vector<string> patterns;
+        for (int k = 0; k < numPatterns; k++) {
+            patterns.push_back(string{letter(), letter(), '[', letter(),
+                                      letter(), ']', '+', letter()});
+        }
+
+        RegexSet set(patterns);
+        vector<unique_ptr<Matcher>> each;
+        for (int k = 0; k < set.size(); k++)
+            each.push_back(make_unique<Matcher>(set.getRegex(k)));
+        SetMatcher setMatcher(set);
+
+        cout << "Search " << lines.size() << " lines for " << numPatterns
+             << " patterns" << endl;
+        report("each regex in turn", nsPerByte(haystack.length(), [&]() {
+            for (string_view line : lines) {
+                for (unique_ptr<Matcher> &m : each)
+                    m->find(line);
+            }
+        }));
+        report("RegexSet", nsPerByte(haystack.length(), [&]() {
+            for (string_view line : lines)
+                setMatcher.search(line);
+        }));
+    }
+    cout << endl;
+}
+
+
+/*! Compare finding many prefixed regexes one at a time with finding them
+ *  all in one Teddy scan, and the Teddy kernels with each other.
+ */
+void bench_teddy() {
+    const string haystack = makeHaystack(1 << 20);
+
+    mt19937 rng(7);
+    auto letter = [&]() { return (char) ('a' + rng() % 26); };
+
+    for (int numPatterns : {8, 32, 64}) {
+        vector<string> literals;
+        vector<unique_ptr<Regex>> regexes;
+        vector<const Regex *> pointers;
+        for (int k = 0; k < numPatterns; k++) {
+            // Uppercase letters don't occur in the haystack, so that every
+            // pattern has to be searched for to the end.
+            string literal{letter(), letter(), (char) ('A' + k % 26)};
+            literals.push_back(literal);
+            regexes.push_back(make_unique<Regex>(literal + "[xyz]+q"));
+            pointers.push_back(regexes.back().get());
+        }
+
+        vector<unique_ptr<Matcher>> each;
+        for (const unique_ptr<Regex> &regex : regexes)
+            each.push_back(make_unique<Matcher>(*regex));
+        MultiFinder finder(pointers);
+
+        cout << "Find " << numPatterns << " prefixed patterns in "
+             << haystack.length() << " bytes" << endl;
+        report("each regex in turn", nsPerByte(haystack.length(), [&]() {
+            for (unique_ptr<Matcher> &m : each)
+                m->find(haystack);
+        }));
+        report("MultiFinder", nsPerByte(haystack.length(), [&]() {
+            finder.find(haystack);
+        }));
+
+        const char *names[] = {"scalar", "SSSE3", "AVX2"};
+        for (int kernel = 0; kernel <= TeddyScanner::bestKernel(); kernel++) {
+            TeddyScanner scanner(literals, (TeddyScanner::Kernel) kernel);
+            report(string("Teddy scan, ") + names[kernel],
+                   nsPerByte(haystack.length(), [&]() {
+                       uint64_t found;
+                       for (int p = scanner.next(haystack, 0, found); p != -1;
+                            p = scanner.next(haystack, p + 1, found)) {
+                           // Keep going.
+                       }
+                   }));
+        }
+    }
+    cout << endl;
+}
+
+
+/*! Compare the engines on short tokens in log lines, where the Shift-And
+ *  engine's one-word state shines.
+ */
+void bench_shift_and() {
+    mt19937 rng(17);
+    const char *levels[] = {"INFO", "WARN", "DEBUG", "ERROR"};
+    const char *users[] = {"alice", "bob", "carol", "dave", "erin"};
+    vector<string> lines;
+    size_t linesLength = 0;
+    for (int i = 0; i < 4000; i++) {
+        string line = "2024-10-17 12:" + to_string(10 + rng() % 50) + ":" +
+            to_string(10 + rng() % 50) + " " + levels[rng() % 4] +
+            " req=" + to_string(rng() % 100000) +
+            " user=" + users[rng() % 5] +
+            " latency=" + to_string(rng() % 2000) + "ms" +
+            " status=" + to_string(200 + rng() % 4 * 100) +
+            " path=/api/v" + to_string(1 + rng() % 3) + "/items";
+        linesLength += line.length();
+        lines.push_back(line);
+    }
+
+    const vector<string> patterns = {
+        "[0123456789]+ms", "user=[^ ]+", "[0123456789]+\\.?[0123456789]*",
+        "v[0123456789]+/[^ /]+", "[0123456789]+:[0123456789]+ [^ ]+"
+    };
+    const pair<Engine, const char *> engines[] = {
+        {Engine::BACKTRACK, "backtracking"}, {Engine::PIKE_VM, "Pike VM"},
+        {Engine::DFA, "DFA"}, {Engine::SHIFT_AND, "Shift-And"}
+    };
+
+    cout << "Every match in " << lines.size() << " log lines" << endl;
+    for (const string &pattern : patterns) {
+        const Regex regex(pattern);
+        cout << "  " << pattern << endl;
+        for (const auto &[engine, name] : engines) {
+            Matcher matcher(regex, engine);
+            report(string("  ") + name, nsPerByte(linesLength, [&]() {
+                for (const string &line : lines) {
+                    for (const Range &r : matcher.findAll(line))
+                        (void) r;
+                }
+            }));
+        }
+    }
+    cout << endl;
+}
+
+
+/*! Measure how the cost of approximate matching grows with the number of
+ *  errors allowed.
+ */
+void bench_approx() {
+    const string haystack = makeHaystack(1 << 20);
+
+    // Three uppercase letters, so that no match is close enough to stop
+    // the scan early
+    const Regex regex("getUserNameQ");
+    ApproxSearcher searcher(regex.getOperators());
+    Matcher matcher(regex, Engine::SHIFT_AND);
+
+    cout << "Approximate search for getUserNameQ, " << haystack.length()
+         << " byte buffer" << endl;
+    report("exact, Shift-And", nsPerByte(haystack.length(), [&]() {
+        matcher.find(haystack);
+    }));
+    for (int maxErrors = 0; maxErrors <= 2; maxErrors++) {
+        report("approximate, " + to_string(maxErrors) + " errors",
+               nsPerByte(haystack.length(), [&]() {
+                   searcher.find(haystack, maxErrors);
+               }));
+    }
+    cout << endl;
+}
+
+
+/*! Compare an alternation in one regex with its alternatives searched for
+ *  one at a time, and a counted repetition with the same repetition written
+ *  out in full.
+ */
+void bench_extended_syntax() {
+    const string haystack = makeHaystack(1 << 20);
+
+    // Q doesn't occur in the haystack, so every search runs to the end.
+    const vector<string> words = {"the", "and", "for", "with"};
+    string alternation;
+    vector<unique_ptr<Regex>> regexes;
+    for (const string &word : words) {
+        alternation += (alternation.empty() ? "(" : "|") + word;
+        regexes.push_back(make_unique<Regex>(word + "[^ ]*Q"));
+    }
+    alternation += ")[^ ]*Q";
+
+    const Regex combined(alternation);
+    Matcher combinedMatcher(combined);
+    vector<unique_ptr<Matcher>> each;
+    for (const unique_ptr<Regex> &regex : regexes)
+        each.push_back(make_unique<Matcher>(*regex));
+
+    cout << "Find " << alternation << " in " << haystack.length()
+         << " bytes" << endl;
+    report("each alternative in turn", nsPerByte(haystack.length(), [&]() {
+        for (unique_ptr<Matcher> &m : each)
+            m->find(haystack);
+    }));
+    report("one alternation, DFA", nsPerByte(haystack.length(), [&]() {
+        combinedMatcher.find(haystack);
+    }));
+    cout << endl;
+
+    const string counted = "([abcde][^ ]){6,12}Q";
+    string written;
+    for (int i = 0; i < 12; i++)
+        written += i < 6 ? "([abcde][^ ])" : "([abcde][^ ])?";
+    written += "Q";
+
+    cout << "Find a group repeated 6 to 12 times, " << haystack.length()
+         << " bytes" << endl;
+    for (const string &pattern : {counted, written}) {
+        const Regex regex(pattern);
+        string name = pattern == counted ? "counted" : "written out";
+        name += " (" + to_string(regex.getProgram().size()) +
+            " instructions)";
+        for (Engine engine : {Engine::DFA, Engine::PIKE_VM}) {
+            Matcher matcher(regex, engine);
+            report(name + (engine == Engine::DFA ? ", DFA" : ", Pike VM"),
+                   nsPerByte(haystack.length(), [&]() {
+                       matcher.find(haystack);
+                   }));
+        }
+    }
+    cout << endl;
+
+    // Every x starts a thread, and each one has its own counter value, so
+    // about a thousand threads are live at once.  The lazy DFA's states are
+    // too large to cache, so it falls back to the Pike VM.
+    const Regex window("x.{0,1000}y");
+    const string xs(4000, 'x');
+
+    cout << "Find x.{0,1000}y in " << xs.length() << " x's" << endl;
+    for (Engine engine : {Engine::DFA, Engine::PIKE_VM}) {
+        Matcher matcher(window, engine);
+        report(engine == Engine::DFA ? "DFA" : "Pike VM",
+               nsPerByte(xs.length(), [&]() {
+                   matcher.find(xs);
+               }));
+    }
+    cout << endl;
+}
+
+
+/*! Compare parsing a pattern onto the heap and freeing it operator by
+ *  operator with parsing it into an arena.
+ */
+void bench_arena() {
+    const string pattern = "ab+c?d*[ef]+g[^ghi]*j.+kx[yz]*.?[^ ]+q";
+
+    cout << "Parse and free a " << pattern.length() << " character pattern"
+         << endl;
+
+    report("heap operators + clearRegex", nsPerByte(pattern.length(), [&]() {
+        vector<RegexOperator *> regex = parseRegex(pattern);
+        clearRegex(regex);
+    }));
+    report("arena", nsPerByte(pattern.length(), [&]() {
+        RegexArena arena;
+        parseRegex(pattern, arena);
+    }));
+    cout << endl;
+}
+
+
+static constexpr char STATIC_COMPLEX[] = "ab+c?d*[ef]+g[^ghi]*j.+k";
+static constexpr char STATIC_VOWELS[] = "[aeiou]+[xyz]+Q";
+static constexpr char STATIC_WORD[] = "e[^ ]+Z";
+
+
+/* Compare one pattern compiled at runtime with the same pattern compiled by
+ * StaticRegex, on short lines and on one long buffer.
+ */
+template <const char *Pattern>
+static void benchStaticPattern(const vector<string> &lines,
+                               size_t linesLength, const string &haystack) {
+    const Regex regex(Pattern);
+    Matcher matcher(regex);
+    Matcher backtrack(regex, Engine::BACKTRACK);
+    string pattern(Pattern);
+
+    report("runtime, lines:    " + pattern, nsPerByte(linesLength, [&]() {
+        for (const string &line : lines)
+            matcher.find(line);
+    }));
+    report("backtrack, lines:  " + pattern, nsPerByte(linesLength, [&]() {
+        for (const string &line : lines)
+            backtrack.find(line);
+    }));
+    report("static, lines:     " + pattern, nsPerByte(linesLength, [&]() {
+        for (const string &line : lines)
+            StaticRegex<Pattern>::find(line);
+    }));
+    report("runtime, buffer:   " + pattern, nsPerByte(haystack.length(), [&]() {
+        matcher.find(haystack);
+    }));
+    report("static, buffer:    " + pattern, nsPerByte(haystack.length(), [&]() {
+        StaticRegex<Pattern>::find(haystack);
+    }));
+}
+
+
+/*! Compare patterns parsed at runtime with the same patterns parsed at
+ *  compile time.
+ */
+void bench_static_regex() {
+    const string haystack = makeHaystack(1 << 20);
+
+    // Split the buffer into 80-character lines, as if searching a log.
+    vector<string> lines;
+    size_t linesLength = 0;
+    for (size_t i = 0; i < haystack.length(); i += 80) {
+        lines.push_back(haystack.substr(i, 80));
+        linesLength += lines.back().length();
+    }
+
+    cout << "Compile-time regex, " << lines.size() << " lines and a "
+         << haystack.length() << " byte buffer" << endl;
+
+    benchStaticPattern<STATIC_COMPLEX>(lines, linesLength, haystack);
+    benchStaticPattern<STATIC_VOWELS>(lines, linesLength, haystack);
+    benchStaticPattern<STATIC_WORD>(lines, linesLength, haystack);
+    cout << endl;
+}
+
+
+/*! This program runs a set of regex engine benchmarks. */
+int main() {
+    bench_bytecode();
+    bench_char_classes();
+    bench_repetition_runs();
+    bench_shared_regex();
+    bench_literal();
+    bench_static_regex();
+    bench_regex_cache();
+    bench_arena();
+    bench_find_all();
+    bench_stream();
+    bench_parallel();
+    bench_batch();
+    bench_regex_set();
+    bench_teddy();
+    bench_shift_and();
+    bench_approx();
+    bench_extended_syntax();
+    return 0;
+}
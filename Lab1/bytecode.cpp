@@ -0,0 +1,212 @@
+#include "bytecode.h"
+
+#include <algorithm>
+
+
+/* Compile the operators into a bytecode program.  Each operator becomes one
+ * instruction; character classes get their bitmaps copied into the program.
+ */
+ByteProgram::ByteProgram(const vector<RegexOperator *> &regex) {
+    for (const RegexOperator *op : regex) {
+        ByteInst inst{ByteInst::CLASS, 0, op->getMinRepeat(),
+                      op->getMaxRepeat(), -1};
+
+        if (auto *mc = dynamic_cast<const MatchChar *>(op)) {
+            inst.opcode = ByteInst::CHAR;
+            inst.c = mc->getChar();
+        }
+        else if (dynamic_cast<const MatchAny *>(op) != nullptr) {
+            inst.opcode = ByteInst::ANY;
+        }
+        else {
+            inst.set = (int) sets.size();
+            sets.push_back(op->getMatchingChars());
+        }
+
+        insts.push_back(inst);
+    }
+}
+
+
+/* Returns the number of instructions in the program. */
+int ByteProgram::size() const {
+    return (int) insts.size();
+}
+
+
+/* Returns the instruction at the specified program counter. */
+const ByteInst & ByteProgram::operator[](int pc) const {
+    assert(pc >= 0 && pc < (int) insts.size());
+    return insts[pc];
+}
+
+
+/* Returns the character set with the specified index. */
+const CharSet & ByteProgram::getSet(int set) const {
+    assert(set >= 0 && set < (int) sets.size());
+    return sets[set];
+}
+
+
+BytecodeVM::BytecodeVM(const ByteProgram &prog, size_t memoBudget) :
+    prog(prog), memoBudget(memoBudget), counts(prog.size()),
+    starts(prog.size()), memoizing(false), memoStride(0) {
+    // Nothing else to do.
+}
+
+
+/* Turn memoizing on if there is a bit for every state of the string, and
+ * forget every state entered so far.
+ */
+void BytecodeVM::startSearch(string_view s) {
+    for (int word : dirtyWords)
+        visited[word] = 0;
+    dirtyWords.clear();
+
+    memoStride = (int) s.length() + 1;
+    size_t bits = (size_t) prog.size() * memoStride;
+    memoizing = bits <= memoBudget;
+
+    if (memoizing && visited.size() < (bits + 63) / 64) {
+        visited.resize((bits + 63) / 64);
+        dirtyWords.reserve(visited.size());
+    }
+}
+
+
+/* Record that the search is entering instruction pc at index pos.  Returns
+ * false if it has been there before, in which case that path already failed.
+ */
+inline bool BytecodeVM::enter(int pc, int pos) {
+    if (!memoizing || pc == prog.size())
+        return true;
+
+    size_t bit = (size_t) pc * memoStride + pos;
+    uint64_t &word = visited[bit >> 6];
+    uint64_t mask = (uint64_t) 1 << (bit & 63);
+    if (word & mask)
+        return false;
+    if (word == 0)
+        dirtyWords.push_back((int) (bit >> 6));
+    word |= mask;
+    return true;
+}
+
+
+/* Reports whether the last startSearch() turned memoizing on. */
+bool BytecodeVM::isMemoizing() const {
+    return memoizing;
+}
+
+
+/* Returns how many characters, starting at s[pos] and up to limit of them,
+ * the instruction matches in a row.  Runs of a character class are found
+ * with the vectorized scan.
+ */
+static int matchRun(const ByteProgram &prog, const ByteInst &inst,
+                    string_view s, int pos, int limit) {
+    int n = 0;
+    switch (inst.opcode) {
+    case ByteInst::CHAR:
+        while (n < limit && s[pos + n] == inst.c)
+            n++;
+        break;
+
+    case ByteInst::ANY:
+        n = limit;
+        break;
+
+    case ByteInst::CLASS: {
+        const char *begin = s.data() + pos;
+        n = (int) (findFirstNonMember(prog.getSet(inst.set), begin,
+                                      begin + limit) - begin);
+        break;
+    }
+    }
+    return n;
+}
+
+
+/* Find the match starting at the specified index, or return the range
+ * (-1, -1) if there isn't one.  The match may be empty.
+ */
+Range BytecodeVM::findAtIndex(string_view s, int start) {
+    startSearch(s);
+    return tryIndex(s, start);
+}
+
+
+/* The same as findAtIndex(), without forgetting the states that earlier
+ * start indexes failed from.
+ */
+Range BytecodeVM::tryIndex(string_view s, int start) {
+    int length = (int) s.length();
+    int pos = start;
+    int pc = 0;
+
+    if (!enter(pc, pos))
+        return Range(-1, -1);
+
+    while (pc < prog.size()) {
+        const ByteInst &inst = prog[pc];
+
+        // Apply the instruction as many times as possible.
+        int limit = length - pos;
+        if (inst.maxRepeat != -1)
+            limit = min(limit, inst.maxRepeat);
+
+        int n = matchRun(prog, inst, s, pos, limit);
+        if (n >= inst.minRepeat) {
+            counts[pc] = n;
+            starts[pc] = pos;
+            pos += n;
+            pc++;
+            if (enter(pc, pos))
+                continue;
+        }
+
+        // Backtrack to the most recent instruction that can give up a
+        // character and land in a state that hasn't been tried yet, and
+        // retry from there.
+        for (;;) {
+            if (pc == 0)
+                return Range(-1, -1);
+
+            pc--;
+            bool retry = false;
+            while (!retry && counts[pc] > prog[pc].minRepeat) {
+                counts[pc]--;
+                pos = starts[pc] + counts[pc];
+                retry = enter(pc + 1, pos);
+            }
+            if (retry) {
+                pc++;
+                break;
+            }
+        }
+    }
+
+    return Range(start, pos);
+}
+
+
+/* Find the first non-empty match in the string. */
+Range BytecodeVM::find(string_view s) {
+    startSearch(s);
+    for (int i = 0; i < (int) s.length(); i++) {
+        Range r = tryIndex(s, i);
+        if (r.start != r.end)
+            return r;
+    }
+    return Range(-1, -1);
+}
+
+
+/* Reports whether the regex matches the entire string.  Only the match
+ * starting at index 0 can cover the whole string, so that is the only one
+ * tried.
+ */
+bool BytecodeVM::match(string_view s) {
+    Range r = findAtIndex(s, 0);
+    return r.end > r.start && r.end == (int) s.length();
+}
@@ -0,0 +1,106 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "regex.h"
+
+#include <cstdint>
+
+
+/* A single instruction of a bytecode program.  Each instruction corresponds
+ * to one regex operator, and says how to test a character and how many times
+ * the test may repeat.
+ *
+ * CHAR matches the character c.  ANY matches any character.  CLASS matches
+ * any character in one of the program's character sets; inverted character
+ * classes are stored as the complement of the excluded characters.
+ */
+struct ByteInst {
+    enum Opcode : uint8_t { CHAR, ANY, CLASS };
+
+    Opcode opcode;
+    char c;
+
+    // The repeat counts, with the same meaning as for RegexOperator
+    int minRepeat, maxRepeat;
+
+    // The index of the character set, for CLASS instructions
+    int set;
+};
+
+
+/* A regex compiled from the operators produced by parseRegex() into a flat
+ * array of instructions.  Unlike the operators, the program can be run
+ * without any virtual calls, and everything it needs is stored in two
+ * contiguous arrays.
+ */
+class ByteProgram {
+    vector<ByteInst> insts;
+    vector<CharSet> sets;
+
+public:
+    ByteProgram(const vector<RegexOperator *> &regex);
+
+    int size() const;
+    const ByteInst & operator[](int pc) const;
+    const CharSet & getSet(int set) const;
+};
+
+
+/* An interpreter that runs a ByteProgram with the same backtracking algorithm
+ * as findAtIndex(), so it finds exactly the same matches.  Since every
+ * instruction consumes exactly one character per repetition, the interpreter
+ * only needs to remember how many times each instruction repeated, and where
+ * it started.
+ *
+ * Whether the rest of the program can match from instruction pc at index pos
+ * doesn't depend on how the search got there, so once a (pc, pos) state has
+ * failed it will always fail.  When the string is short enough that a bit
+ * for every state fits in the memo budget, the interpreter remembers the
+ * states it has entered and never explores one twice, which bounds a search
+ * to O(n * m) steps instead of exponentially many.  The states stay valid
+ * across start indexes in the same string, so a whole find() is O(n * m).
+ */
+class BytecodeVM {
+    const ByteProgram &prog;
+    size_t memoBudget;
+
+    // Scratch space, kept between searches so that they don't allocate
+    vector<int> counts;
+    vector<int> starts;
+
+    // One bit per (pc, pos) state already entered, indexed by
+    // pc * (length + 1) + pos, when memoizing is on.  The words that have
+    // any bits set are listed, so that forgetting the states only costs as
+    // much as the search that entered them.
+    vector<uint64_t> visited;
+    vector<int> dirtyWords;
+    bool memoizing;
+    int memoStride;
+
+    bool enter(int pc, int pos);
+
+public:
+    // The default number of bits the visited states may take up
+    static constexpr size_t DEFAULT_MEMO_BUDGET = 1 << 21;
+
+    BytecodeVM(const ByteProgram &prog,
+               size_t memoBudget = DEFAULT_MEMO_BUDGET);
+
+    // Prepare to try one or more start indexes in the string.  Failed states
+    // are remembered until the next call.
+    void startSearch(string_view s);
+
+    // Find the match at the specified index of the string passed to the last
+    // startSearch().  The match may be empty.
+    Range tryIndex(string_view s, int start);
+
+    Range findAtIndex(string_view s, int start);
+    Range find(string_view s);
+    bool match(string_view s);
+
+    // Reports whether the last startSearch() turned memoizing on.
+    bool isMemoizing() const;
+};
+
+
+#endif // BYTECODE_H
@@ -0,0 +1,108 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <functional>
+
+
+RegexCache::RegexCache(size_t capacity, int numShards) :
+    numShards((int) min<size_t>(numShards, capacity)),
+    hits(0), misses(0), evictions(0) {
+    assert(capacity > 0 && numShards > 0);
+
+    // Split the capacity as evenly as it goes, so that the shards hold
+    // exactly the requested capacity between them, and each holds at least
+    // one pattern.
+    shards.reset(new Shard[this->numShards]);
+    for (int i = 0; i < this->numShards; i++) {
+        shards[i].capacity = capacity / this->numShards;
+        if (i < (int) (capacity % this->numShards))
+            shards[i].capacity++;
+    }
+}
+
+
+/* Returns the shard that holds the pattern. */
+RegexCache::Shard & RegexCache::shardFor(const string &pattern) {
+    return shards[hash<string>()(pattern) % numShards];
+}
+
+
+/* Returns the compiled regex for the pattern, compiling it if it isn't
+ * cached, and marks it as the most recently used pattern in its shard.
+ */
+RegexCache::Handle RegexCache::get(const string &pattern) {
+    Shard &shard = shardFor(pattern);
+
+    {
+        lock_guard<mutex> guard(shard.lock);
+        auto it = shard.index.find(pattern);
+        if (it != shard.index.end()) {
+            shard.entries.splice(shard.entries.begin(), shard.entries,
+                                 it->second);
+            hits++;
+            return it->second->second;
+        }
+    }
+
+    // Compiling takes far longer than a lookup, so don't hold up other
+    // threads using the shard while it happens.
+    misses++;
+    Handle compiled = make_shared<const Regex>(pattern);
+
+    lock_guard<mutex> guard(shard.lock);
+
+    // Another thread may have compiled the same pattern in the meantime; if
+    // so, everyone should share its copy.
+    auto it = shard.index.find(pattern);
+    if (it != shard.index.end()) {
+        shard.entries.splice(shard.entries.begin(), shard.entries,
+                             it->second);
+        return it->second->second;
+    }
+
+    shard.entries.emplace_front(pattern, compiled);
+    shard.index[pattern] = shard.entries.begin();
+
+    while (shard.entries.size() > shard.capacity) {
+        shard.index.erase(shard.entries.back().first);
+        shard.entries.pop_back();
+        evictions++;
+    }
+    return compiled;
+}
+
+
+/* Drop every compiled pattern.  Handles already returned stay valid. */
+void RegexCache::clear() {
+    for (int i = 0; i < numShards; i++) {
+        lock_guard<mutex> guard(shards[i].lock);
+        shards[i].index.clear();
+        shards[i].entries.clear();
+    }
+}
+
+
+/* Returns the number of compiled patterns in the cache. */
+size_t RegexCache::size() const {
+    size_t total = 0;
+    for (int i = 0; i < numShards; i++) {
+        lock_guard<mutex> guard(shards[i].lock);
+        total += shards[i].entries.size();
+    }
+    return total;
+}
+
+
+RegexCacheStats RegexCache::getStats() const {
+    RegexCacheStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    return stats;
+}
+
+
+RegexCache & RegexCache::global() {
+    static RegexCache cache;
+    return cache;
+}
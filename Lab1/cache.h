@@ -0,0 +1,87 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "matcher.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+
+/* Counters describing how well a RegexCache is performing. */
+struct RegexCacheStats {
+    // Lookups that found the pattern already compiled
+    long long hits = 0;
+
+    // Lookups that had to compile the pattern
+    long long misses = 0;
+
+    // Compiled patterns dropped to stay within the capacity
+    long long evictions = 0;
+};
+
+
+/* A bounded cache of compiled regexes, keyed by pattern text, so that code
+ * that keeps using the same patterns only parses and compiles each one once.
+ *
+ * Lookups return shared handles.  A handle keeps its Regex, and the operators
+ * the Regex owns, alive for as long as it is held, even after the cache has
+ * evicted the pattern, so callers never need clearRegex().  Matchers only
+ * borrow the Regex, so the handle must outlive any Matcher made from it.
+ *
+ * The cache is split into shards, each with its own lock and its own least-
+ * recently-used list, and a pattern always goes to the same shard, so threads
+ * looking up different patterns rarely contend.  Each shard holds an equal
+ * share of the capacity, give or take one, so eviction is only
+ * least-recently-used within a shard.  There are never more shards than
+ * the capacity.  Patterns are compiled outside the lock.
+ */
+class RegexCache {
+public:
+    using Handle = shared_ptr<const Regex>;
+
+    static constexpr size_t DEFAULT_CAPACITY = 256;
+    static constexpr int DEFAULT_SHARDS = 16;
+
+    RegexCache(size_t capacity = DEFAULT_CAPACITY,
+               int numShards = DEFAULT_SHARDS);
+
+    RegexCache(const RegexCache &other) = delete;
+    RegexCache & operator=(const RegexCache &other) = delete;
+
+    // Returns the compiled regex for the pattern, compiling it if needed.
+    Handle get(const string &pattern);
+
+    // Drop every compiled pattern.  Handles already returned stay valid.
+    void clear();
+
+    size_t size() const;
+    RegexCacheStats getStats() const;
+
+    // A process-wide cache, for code that doesn't want to manage its own
+    static RegexCache & global();
+
+private:
+    struct Shard {
+        mutable mutex lock;
+
+        // The most patterns the shard holds
+        size_t capacity;
+
+        // Most recently used first
+        list<pair<string, Handle>> entries;
+        unordered_map<string, list<pair<string, Handle>>::iterator> index;
+    };
+
+    unique_ptr<Shard[]> shards;
+    int numShards;
+
+    atomic<long long> hits, misses, evictions;
+
+    Shard & shardFor(const string &pattern);
+};
+
+
+#endif // CACHE_H
@@ -0,0 +1,182 @@
+#include "charclass.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CHARCLASS_X86 1
+#include <immintrin.h>
+#endif
+
+
+CharSet::CharSet() {
+    for (int i = 0; i < 4; i++)
+        bits[i] = 0;
+    for (int h = 0; h < 2; h++) {
+        for (int lo = 0; lo < 16; lo++)
+            nibbleTables[h][lo] = 0;
+    }
+}
+
+
+/* Add a character to the set. */
+void CharSet::add(unsigned char c) {
+    bits[c >> 6] |= (uint64_t) 1 << (c & 63);
+    nibbleTables[c >> 7][c & 0x0F] |= 1 << ((c >> 4) & 7);
+}
+
+
+/* Add every character in the array to the set. */
+void CharSet::add(const char *chars, int length) {
+    for (int i = 0; i < length; i++)
+        add((unsigned char) chars[i]);
+}
+
+
+/* Add every character in the other set to this set. */
+void CharSet::add(const CharSet &other) {
+    for (int i = 0; i < 4; i++)
+        bits[i] |= other.bits[i];
+    for (int h = 0; h < 2; h++) {
+        for (int lo = 0; lo < 16; lo++)
+            nibbleTables[h][lo] |= other.nibbleTables[h][lo];
+    }
+}
+
+
+/* Add every possible character to the set. */
+void CharSet::addAll() {
+    for (int c = 0; c < 256; c++)
+        add((unsigned char) c);
+}
+
+
+/* Returns the set of characters that are not in this set.  Every bit of the
+ * nibble tables stands for exactly one character, so they are complemented
+ * along with the bitmap.
+ */
+CharSet CharSet::complement() const {
+    CharSet result;
+    for (int i = 0; i < 4; i++)
+        result.bits[i] = ~bits[i];
+    for (int h = 0; h < 2; h++) {
+        for (int lo = 0; lo < 16; lo++)
+            result.nibbleTables[h][lo] = (uint8_t) ~nibbleTables[h][lo];
+    }
+    return result;
+}
+
+
+/* Returns the number of characters in the set. */
+int CharSet::count() const {
+    int n = 0;
+    for (int i = 0; i < 4; i++)
+        n += __builtin_popcountll(bits[i]);
+    return n;
+}
+
+
+static const char * findFirstNonMemberScalar(const CharSet &set,
+                                             const char *begin,
+                                             const char *end) {
+    while (begin < end && set.contains((unsigned char) *begin))
+        begin++;
+    return begin;
+}
+
+
+#ifdef CHARCLASS_X86
+
+/* Classify 32 characters at a time.  For each character, the low nibble
+ * selects a row of the nibble tables, the high nibble selects which of the two
+ * tables to use and which bit of the row to test.
+ */
+__attribute__((target("avx2")))
+static const char * findFirstNonMemberAVX2(const uint8_t tables[2][16],
+                                           const CharSet &set,
+                                           const char *begin,
+                                           const char *end) {
+    const __m256i low = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *) tables[0]));
+    const __m256i high = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *) tables[1]));
+    const __m256i bitForNibble = _mm256_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+    const __m256i seven = _mm256_set1_epi8(7);
+
+    for (; end - begin >= 32; begin += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) begin);
+        __m256i lo = _mm256_and_si256(v, nibbleMask);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibbleMask);
+
+        __m256i row = _mm256_blendv_epi8(_mm256_shuffle_epi8(low, lo),
+                                         _mm256_shuffle_epi8(high, lo),
+                                         _mm256_cmpgt_epi8(hi, seven));
+        __m256i bit = _mm256_shuffle_epi8(bitForNibble, hi);
+        __m256i member = _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit);
+
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(member);
+        if (mask != 0xFFFFFFFF)
+            return begin + __builtin_ctz(~mask);
+    }
+
+    return findFirstNonMemberScalar(set, begin, end);
+}
+
+
+/* The same as findFirstNonMemberAVX2(), 16 characters at a time. */
+__attribute__((target("ssse3,sse4.1")))
+static const char * findFirstNonMemberSSE(const uint8_t tables[2][16],
+                                          const CharSet &set,
+                                          const char *begin,
+                                          const char *end) {
+    const __m128i low = _mm_loadu_si128((const __m128i *) tables[0]);
+    const __m128i high = _mm_loadu_si128((const __m128i *) tables[1]);
+    const __m128i bitForNibble = _mm_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+    const __m128i seven = _mm_set1_epi8(7);
+
+    for (; end - begin >= 16; begin += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) begin);
+        __m128i lo = _mm_and_si128(v, nibbleMask);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibbleMask);
+
+        __m128i row = _mm_blendv_epi8(_mm_shuffle_epi8(low, lo),
+                                      _mm_shuffle_epi8(high, lo),
+                                      _mm_cmpgt_epi8(hi, seven));
+        __m128i bit = _mm_shuffle_epi8(bitForNibble, hi);
+        __m128i member = _mm_cmpeq_epi8(_mm_and_si128(row, bit), bit);
+
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(member);
+        if (mask != 0xFFFF)
+            return begin + __builtin_ctz(~mask);
+    }
+
+    return findFirstNonMemberScalar(set, begin, end);
+}
+
+#endif // CHARCLASS_X86
+
+
+const char * findFirstNonMember(const CharSet &set, const char *begin,
+                                const char *end) {
+#ifdef CHARCLASS_X86
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    static const bool hasSSE = __builtin_cpu_supports("ssse3") &&
+        __builtin_cpu_supports("sse4.1");
+
+    // Most runs are short, and aren't worth setting up the vector registers
+    // for, so check the first few characters on their own.
+    for (int i = 0; i < 8; i++, begin++) {
+        if (begin == end || !set.contains((unsigned char) *begin))
+            return begin;
+    }
+
+    if (end - begin >= 32 && hasAVX2)
+        return findFirstNonMemberAVX2(set.nibbleTables, set, begin, end);
+    if (end - begin >= 16 && hasSSE)
+        return findFirstNonMemberSSE(set.nibbleTables, set, begin, end);
+#endif
+
+    return findFirstNonMemberScalar(set, begin, end);
+}
@@ -0,0 +1,61 @@
+#ifndef CHARCLASS_H
+#define CHARCLASS_H
+
+#include <cstdint>
+
+
+/* A set of characters, stored as a 256-bit membership bitmap so that testing
+ * a character is a single shift and mask, regardless of how many characters
+ * are in the set.
+ *
+ * The set also keeps the same bitmap rearranged into two 16-entry tables
+ * indexed by the low nibble of a character, which lets findFirstNonMember()
+ * classify 16 or 32 characters at a time with byte shuffles.
+ */
+class CharSet {
+    uint64_t bits[4];
+
+    // nibbleTables[h / 8][lo] has bit (h % 8) set iff the character with
+    // high nibble h and low nibble lo is in the set.
+    uint8_t nibbleTables[2][16];
+
+    friend const char * findFirstNonMember(const CharSet &set,
+                                           const char *begin,
+                                           const char *end);
+
+public:
+    // Initialize an empty set.
+    CharSet();
+
+    void add(unsigned char c);
+    void add(const char *chars, int length);
+    void add(const CharSet &other);
+    void addAll();
+
+    CharSet complement() const;
+    int count() const;
+
+    bool contains(unsigned char c) const {
+        return (bits[c >> 6] >> (c & 63)) & 1;
+    }
+
+    // Call f with each character in the set, in increasing order.
+    template <typename F>
+    void forEach(F f) const {
+        for (int i = 0; i < 4; i++) {
+            for (uint64_t word = bits[i]; word != 0; word &= word - 1)
+                f((unsigned char) (i * 64 + __builtin_ctzll(word)));
+        }
+    }
+};
+
+
+/* Returns a pointer to the first character in the range [begin, end) that
+ * is not in the set, or end if every character is.  Uses AVX2 or SSSE3 when
+ * the processor supports them.
+ */
+const char * findFirstNonMember(const CharSet &set, const char *begin,
+                                const char *end);
+
+
+#endif // CHARCLASS_H
@@ -0,0 +1,466 @@
+#include "dfa.h"
+
+#include <algorithm>
+
+
+DFAStats & DFAStats::operator+=(const DFAStats &other) {
+    cacheHits += other.cacheHits;
+    cacheMisses += other.cacheMisses;
+    cacheFlushes += other.cacheFlushes;
+    bailouts += other.bailouts;
+    return *this;
+}
+
+
+/* Approximate memory cost of a cached state whose threads take the specified
+ * number of ints: the state itself, its thread list (stored twice, once as
+ * the index key), its row of the transition table, and the index node.
+ */
+static size_t stateCost(size_t numPcs, int numClasses) {
+    return sizeof(vector<int>) * 2 + sizeof(bool) + 2 * numPcs * sizeof(int)
+        + numClasses * sizeof(int) + 64;
+}
+
+
+/* Sort the first count ints of the list, as threads of the specified size. */
+static void sortThreads(vector<int> &pcs, size_t count, int threadSize) {
+    if (threadSize == 1) {
+        sort(pcs.begin(), pcs.begin() + count);
+        return;
+    }
+
+    vector<vector<int>> threads;
+    for (size_t i = 0; i < count; i += threadSize)
+        threads.emplace_back(pcs.begin() + i, pcs.begin() + i + threadSize);
+    sort(threads.begin(), threads.end());
+
+    for (size_t k = 0; k < threads.size(); k++)
+        copy(threads[k].begin(), threads[k].end(),
+             pcs.begin() + k * threadSize);
+}
+
+
+LazyDFA::LazyDFA(const NFAProgram &prog, Kind kind, bool anchored,
+                 size_t memoryBudget) :
+    prog(prog), kind(kind), anchored(anchored), memoryBudget(memoryBudget),
+    threadSize(prog.threadSize()), numRegexes(0) {
+
+    computeByteClasses();
+
+    mark.assign(prog.size(), -1);
+    markGeneration = 0;
+
+    // The threads an unanchored search starts at every index; an empty
+    // match doesn't count, so they don't include MATCH instructions.
+    record.assign(threadSize, 0);
+    startClosures();
+    addClosure(startClosure, record.data(), /* includeMatch */ false);
+
+    resetCache();
+}
+
+
+/* Partition the characters into classes, such that two characters are in
+ * the same class if every character set in the program either contains both
+ * or neither.  The partition is refined one set at a time.
+ */
+void LazyDFA::computeByteClasses() {
+    for (int c = 0; c < 256; c++)
+        byteClass[c] = 0;
+    numClasses = 1;
+
+    for (int set = 0; set < prog.numSets(); set++) {
+        const CharSet &chars = prog.getSet(set);
+
+        // Each existing class splits into the characters in the set and the
+        // characters that aren't.
+        vector<int> split(2 * numClasses, -1);
+        int refined = 0;
+        for (int c = 0; c < 256; c++) {
+            int &id = split[2 * byteClass[c] + chars.contains(c)];
+            if (id == -1)
+                id = refined++;
+            byteClass[c] = id;
+        }
+        numClasses = refined;
+    }
+}
+
+
+/* Discard every cached state, and recreate the dead and start states. */
+void LazyDFA::resetCache() {
+    states.clear();
+    stateIndex.clear();
+    transitions.clear();
+    memoryUsed = 0;
+
+    vector<int> pcs;
+    int dead = addState(pcs);
+    assert(dead == DEAD);
+
+    // An unanchored search starts with just the restart thread, which
+    // stands for the threads starting at the current index.
+    record.assign(threadSize, 0);
+    if (anchored) {
+        startClosures();
+        addClosure(pcs, record.data(), /* includeMatch */ true);
+    }
+    else {
+        record[0] = RESTART;
+        pcs = record;
+    }
+    startState = addState(pcs);
+}
+
+
+/* Returns the index of the state with the specified thread list,
+ * creating it if necessary.  The list is put into canonical form first:
+ * a leftmost-first DFA drops every thread with lower priority than a match,
+ * and a longest-match DFA doesn't care about priorities at all.
+ */
+int LazyDFA::addState(vector<int> &pcs) {
+    vector<int> regexes;
+    for (size_t i = 0; i < pcs.size(); i += threadSize) {
+        if (pcs[i] != RESTART && prog[pcs[i]].opcode == NFAInst::MATCH) {
+            regexes.push_back(prog[pcs[i]].x);
+            if (kind == LEFTMOST_FIRST) {
+                pcs.resize(i + threadSize);
+                break;
+            }
+        }
+    }
+
+    // The restart thread stays last.
+    if (kind == LONGEST) {
+        bool restarts = !pcs.empty() &&
+            pcs[pcs.size() - threadSize] == RESTART;
+        sortThreads(pcs, pcs.size() - (restarts ? threadSize : 0),
+                    threadSize);
+        sort(regexes.begin(), regexes.end());
+    }
+
+    auto it = stateIndex.find(pcs);
+    if (it != stateIndex.end())
+        return it->second;
+
+    int id = (int) states.size();
+    bool match = !regexes.empty();
+    states.push_back(State{pcs, match, move(regexes)});
+    stateIndex.emplace(pcs, id);
+    transitions.resize(transitions.size() + numClasses, UNKNOWN);
+    memoryUsed += stateCost(pcs.size(), numClasses);
+
+    return id;
+}
+
+
+/* Start building a new list of threads, in which no thread is marked. */
+void LazyDFA::startClosures() {
+    markGeneration++;
+    marked.clear();
+}
+
+
+/* Append the threads reachable from the thread without consuming input to
+ * the list, in priority order.  Threads already added since startClosures()
+ * was last called are skipped.
+ */
+void LazyDFA::addClosure(vector<int> &pcs, const int *thread,
+                         bool includeMatch) {
+    stack.assign(thread, thread + threadSize);
+
+    while (!stack.empty()) {
+        current.assign(stack.end() - threadSize, stack.end());
+        stack.resize(stack.size() - threadSize);
+        int pc = current[0];
+
+        if (threadSize == 1) {
+            if (mark[pc] == markGeneration)
+                continue;
+            mark[pc] = markGeneration;
+        }
+        else if (!marked.insert(current).second) {
+            continue;
+        }
+
+        switch (prog[pc].opcode) {
+        case NFAInst::CONSUME:
+            pcs.insert(pcs.end(), current.begin(), current.end());
+            break;
+
+        case NFAInst::MATCH:
+            if (includeMatch)
+                pcs.insert(pcs.end(), current.begin(), current.end());
+            break;
+
+        default:
+            prog.follow(current.data(), stack);
+            break;
+        }
+    }
+}
+
+
+/* Append the threads the thread continues to on character c. */
+inline void LazyDFA::advance(vector<int> &pcs, const int *thread,
+                             unsigned char c) {
+    const NFAInst &inst = prog[thread[0]];
+    if (inst.opcode == NFAInst::CONSUME &&
+        prog.getSet(inst.set).contains(c)) {
+        record.assign(thread, thread + threadSize);
+        record[0]++;
+        addClosure(pcs, record.data(), /* includeMatch */ true);
+    }
+}
+
+
+/* Compute the state reached from the specified state on character c. */
+int LazyDFA::computeNext(int state, unsigned char c) {
+    // Copy the thread list, since adding a state can move it.
+    vector<int> threads = states[state].pcs;
+    vector<int> pcs;
+
+    startClosures();
+    for (size_t i = 0; i < threads.size(); i += threadSize) {
+        if (threads[i] == RESTART) {
+            // Advance the lowest-priority threads, which start here, and
+            // start them again at the next index.
+            for (size_t j = 0; j < startClosure.size(); j += threadSize)
+                advance(pcs, &startClosure[j], c);
+            pcs.insert(pcs.end(), threads.begin() + i,
+                       threads.begin() + i + threadSize);
+            break;
+        }
+        advance(pcs, &threads[i], c);
+    }
+
+    return addState(pcs);
+}
+
+
+/* Make sure there is room in the cache for one more state, flushing the
+ * cache if necessary.  The current state is recreated after a flush, so its
+ * index is updated.  Returns false if the cache is thrashing, i.e. it has
+ * been flushed without the DFA scanning enough input to make the cached
+ * states worthwhile.
+ */
+bool LazyDFA::ensureRoom(int &state, long long scanned,
+                         long long &scannedAtFlush) {
+    size_t largest = (size_t) (prog.size() + 1) * threadSize;
+    if (memoryUsed + stateCost(largest, numClasses) <= memoryBudget)
+        return true;
+
+    if (scanned - scannedAtFlush <
+            (long long) MIN_BYTES_PER_STATE * (long long) states.size()) {
+        stats.bailouts++;
+        return false;
+    }
+
+    vector<int> pcs = states[state].pcs;
+    resetCache();
+    state = addState(pcs);
+
+    stats.cacheFlushes++;
+    scannedAtFlush = scanned;
+    return true;
+}
+
+
+/* Returns the state reached from state on character c, computing and caching
+ * the transition if necessary.  Returns -1 if the search must be abandoned.
+ */
+int LazyDFA::step(int &state, unsigned char c, long long scanned,
+                  long long &scannedAtFlush) {
+    int next = transitions[state * numClasses + byteClass[c]];
+    if (next != UNKNOWN) {
+        stats.cacheHits++;
+        return next;
+    }
+
+    stats.cacheMisses++;
+    if (!ensureRoom(state, scanned, scannedAtFlush))
+        return -1;
+
+    next = computeNext(state, c);
+    transitions[state * numClasses + byteClass[c]] = next;
+    return next;
+}
+
+
+bool LazyDFA::searchForward(string_view s, int start, int &matchEnd) {
+    int length = (int) s.length();
+    int state = startState;
+    long long scannedAtFlush = 0;
+
+    matchEnd = -1;
+    for (int i = start; ; i++) {
+        if (states[state].match)
+            matchEnd = i;
+
+        if (state == DEAD || i == length)
+            break;
+
+        state = step(state, (unsigned char) s[i], i - start, scannedAtFlush);
+        if (state == -1)
+            return false;
+    }
+
+    return true;
+}
+
+
+bool LazyDFA::searchReverse(string_view s, int begin, int end,
+                            int &matchStart) {
+    int state = startState;
+    long long scannedAtFlush = 0;
+
+    matchStart = -1;
+    for (int i = end; ; i--) {
+        // The start state may report an empty match, which doesn't count.
+        if (states[state].match && i < end)
+            matchStart = i;
+
+        if (state == DEAD || i == begin)
+            break;
+
+        state = step(state, (unsigned char) s[i - 1], end - i,
+                     scannedAtFlush);
+        if (state == -1)
+            return false;
+    }
+
+    return true;
+}
+
+
+bool LazyDFA::searchSet(string_view s, vector<int> &found) {
+    int length = (int) s.length();
+    int state = startState;
+    long long scannedAtFlush = 0;
+
+    found.clear();
+    if (isFound.empty()) {
+        for (int pc = 0; pc < prog.size(); pc++) {
+            if (prog[pc].opcode == NFAInst::MATCH)
+                numRegexes = max(numRegexes, prog[pc].x + 1);
+        }
+        isFound.assign(numRegexes, false);
+    }
+
+    // Stop early once every regex has matched.
+    for (int i = 0; i < length && state != DEAD &&
+             (int) found.size() < numRegexes; i++) {
+        // Look up cached transitions here, since most of them are, and the
+        // state doesn't have to go through memory.
+        unsigned char c = (unsigned char) s[i];
+        int next = transitions[state * numClasses + byteClass[c]];
+        if (next == UNKNOWN) {
+            next = step(state, c, i, scannedAtFlush);
+            if (next == -1) {
+                for (int k : found)
+                    isFound[k] = false;
+                found.clear();
+                return false;
+            }
+        }
+        else {
+            stats.cacheHits++;
+        }
+        state = next;
+
+        // Every thread in an unanchored state has consumed a character, so
+        // each match it reports is non-empty.
+        if (!anchored && states[state].match) {
+            for (int k : states[state].regexes) {
+                if (!isFound[k]) {
+                    isFound[k] = true;
+                    found.push_back(k);
+                }
+            }
+        }
+    }
+
+    for (int k : found)
+        isFound[k] = false;
+
+    if (anchored && length > 0)
+        found = states[state].regexes;
+    return true;
+}
+
+
+const DFAStats & LazyDFA::getStats() const {
+    return stats;
+}
+
+
+/* Returns the number of states currently in the cache. */
+int LazyDFA::numStates() const {
+    return (int) states.size();
+}
+
+
+DFAEngine::DFAEngine(const NFAProgram &forwardProg,
+                     const NFAProgram &reverseProg, size_t memoryBudget) :
+    forward(forwardProg, LazyDFA::LEFTMOST_FIRST, false, memoryBudget),
+    anchoredForward(forwardProg, LazyDFA::LEFTMOST_FIRST, true, memoryBudget),
+    anchoredLongest(forwardProg, LazyDFA::LONGEST, true, memoryBudget),
+    reverse(reverseProg, LazyDFA::LONGEST, true, memoryBudget),
+    fallback(forwardProg) {
+    // Nothing else to do.
+}
+
+
+/* Find the match that the backtracking engine would find starting at the
+ * specified index.  The match may be empty.
+ */
+Range DFAEngine::findAtIndex(string_view s, int start) {
+    int end;
+    if (!anchoredForward.searchForward(s, start, end))
+        return fallback.findAtIndex(s, start);
+
+    if (end == -1)
+        return Range(-1, -1);
+    return Range(start, end);
+}
+
+
+/* Find the first non-empty match in the string that starts at or after the
+ * specified index.  The forward DFA finds where the match ends; the leftmost
+ * non-empty match ending there is found by running the reversed regex
+ * backward from that point, no further than the start index.
+ */
+Range DFAEngine::find(string_view s, int start) {
+    int matchStart, matchEnd;
+    if (!forward.searchForward(s, start, matchEnd))
+        return fallback.find(s, start);
+
+    if (matchEnd == -1)
+        return Range(-1, -1);
+
+    if (!reverse.searchReverse(s, start, matchEnd, matchStart))
+        return fallback.find(s, start);
+
+    assert(matchStart != -1);
+    return Range(matchStart, matchEnd);
+}
+
+
+/* Reports whether the regex matches the entire string, in any way. */
+bool DFAEngine::match(string_view s) {
+    int end;
+    if (!anchoredLongest.searchForward(s, 0, end))
+        return fallback.match(s);
+    return end > 0 && end == (int) s.length();
+}
+
+
+/* Returns the combined counters of all the DFAs used by the engine. */
+DFAStats DFAEngine::getStats() const {
+    DFAStats total;
+    total += forward.getStats();
+    total += anchoredForward.getStats();
+    total += anchoredLongest.getStats();
+    total += reverse.getStats();
+    return total;
+}
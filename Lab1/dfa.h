@@ -0,0 +1,185 @@
+#ifndef DFA_H
+#define DFA_H
+
+#include "nfa.h"
+
+#include <cstddef>
+#include <map>
+#include <set>
+
+
+/* Counters describing how well a lazy DFA's state cache is performing. */
+struct DFAStats {
+    // Transitions that were already in the cache
+    long long cacheHits = 0;
+
+    // Transitions that had to be computed from the NFA
+    long long cacheMisses = 0;
+
+    // Times the cache exceeded its memory budget and was discarded
+    long long cacheFlushes = 0;
+
+    // Searches abandoned because the cache was thrashing
+    long long bailouts = 0;
+
+    DFAStats & operator+=(const DFAStats &other);
+};
+
+
+/* A DFA that is built lazily from an NFAProgram, one state and transition at
+ * a time, as the input requires them.  Each DFA state is an ordered list of
+ * NFA threads, so that the DFA can honor the same thread priorities as the
+ * Pike VM.  In a program with counters, each thread is an instruction and
+ * its counter values, so a counted repetition has a state for each count
+ * that can be live at once, just as if it had been written out in full.
+ *
+ * A LEFTMOST_FIRST DFA reports where the match the backtracking engine would
+ * choose ends.  A LONGEST DFA reports where the longest match ends; it is run
+ * over the reversed program to recover the start of a match.  A LONGEST DFA
+ * keeps every thread, whatever its priority, so it can also report every
+ * regex of a program compiled from several that matches; see searchSet().
+ *
+ * Determinized states are cached, so that once the cache is warm each input
+ * character costs a single table lookup.  The cache is limited to a memory
+ * budget; when it runs out, every state is discarded and the cache is rebuilt
+ * from the current state.  If the cache is being flushed so often that the
+ * DFA is making little progress, the search gives up so that the caller can
+ * fall back to another engine.
+ */
+class LazyDFA {
+public:
+    enum Kind { LEFTMOST_FIRST, LONGEST };
+
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = 1 << 20;
+
+private:
+    // Pseudo instruction representing the threads that start the search at
+    // every index of an unanchored search.  It is always last in a list, and
+    // stands for the start closure, which isn't stored in every state.
+    static constexpr int RESTART = -1;
+
+    // Transition table entry for transitions that haven't been computed
+    static constexpr int UNKNOWN = -1;
+
+    // The state with no threads; once reached, no match can follow.
+    static constexpr int DEAD = 0;
+
+    // The minimum number of input characters the DFA must scan for each
+    // state it creates, before it is considered to be thrashing.
+    static constexpr int MIN_BYTES_PER_STATE = 10;
+
+    // The threads are records of the size the program's threadSize()
+    // returns; for a program without counters, just the instructions.
+    struct State {
+        vector<int> pcs;
+        bool match;
+
+        // The regexes whose MATCH instructions are in the state, for a
+        // program compiled from several regexes
+        vector<int> regexes;
+    };
+
+    const NFAProgram &prog;
+    Kind kind;
+    bool anchored;
+    size_t memoryBudget;
+    int threadSize;
+
+    // Characters that no instruction can tell apart share a byte class,
+    // which keeps the transition table small.
+    int byteClass[256];
+    int numClasses;
+
+    vector<State> states;
+    map<vector<int>, int> stateIndex;
+    vector<int> transitions;
+    size_t memoryUsed;
+    int startState;
+
+    vector<int> startClosure;
+
+    // The number of regexes the program was compiled from, and which of
+    // them searchSet() has found so far
+    int numRegexes;
+    vector<bool> isFound;
+
+    // Scratch space for building new states.  Threads are marked when they
+    // are added to a state: by instruction, or by the whole record in a
+    // program with counters.
+    vector<int> mark;
+    int markGeneration;
+    set<vector<int>> marked;
+    vector<int> stack;
+    vector<int> record, current;
+
+    DFAStats stats;
+
+    void computeByteClasses();
+    void resetCache();
+    int addState(vector<int> &pcs);
+    void startClosures();
+    void addClosure(vector<int> &pcs, const int *thread, bool includeMatch);
+    void advance(vector<int> &pcs, const int *thread, unsigned char c);
+    int computeNext(int state, unsigned char c);
+    bool ensureRoom(int &state, long long scanned, long long &scannedAtFlush);
+    int step(int &state, unsigned char c, long long scanned,
+             long long &scannedAtFlush);
+
+public:
+    LazyDFA(const NFAProgram &prog, Kind kind, bool anchored,
+            size_t memoryBudget = DEFAULT_MEMORY_BUDGET);
+
+    // Scan forward from start.  Returns false if the search was abandoned;
+    // otherwise sets matchEnd to the end of the match, or -1 if none.
+    bool searchForward(string_view s, int start, int &matchEnd);
+
+    // Scan backward from end, but not past begin.  Returns false if the
+    // search was abandoned; otherwise sets matchStart to the start of a
+    // non-empty match, or -1.
+    bool searchReverse(string_view s, int begin, int end, int &matchStart);
+
+    // Scan the whole string, and set found to the index of every regex of
+    // the program that has a non-empty match: covering the whole string,
+    // for an anchored DFA, or anywhere in it, for an unanchored one.  They
+    // are in no particular order.  Only a LONGEST DFA finds every regex.
+    // Returns false if the search was abandoned.
+    bool searchSet(string_view s, vector<int> &found);
+
+    const DFAStats & getStats() const;
+    int numStates() const;
+};
+
+
+/* A matching engine built on lazy DFAs.
+ *
+ * find() runs an unanchored leftmost-first DFA to find where the match ends,
+ * and then a longest-match DFA over the reversed regex, backward from there,
+ * to find where it starts.  findAtIndex() uses an anchored leftmost-first
+ * DFA, and match() an anchored longest-match DFA, since the string may be
+ * matched in full by a way of matching the regex that isn't the preferred
+ * one.  The reverse program must be compiled from the operators or syntax
+ * tree in reverse order.
+ * Whenever a DFA gives up, the search is repeated with the Pike VM.  The
+ * memory budget applies to each of the DFAs separately.
+ */
+class DFAEngine {
+    LazyDFA forward;
+    LazyDFA anchoredForward;
+    LazyDFA anchoredLongest;
+    LazyDFA reverse;
+
+    PikeVM fallback;
+
+public:
+    DFAEngine(const NFAProgram &forwardProg, const NFAProgram &reverseProg,
+              size_t memoryBudget = LazyDFA::DEFAULT_MEMORY_BUDGET);
+
+    Range findAtIndex(string_view s, int start);
+    Range find(string_view s, int start = 0);
+    bool match(string_view s);
+
+    DFAStats getStats() const;
+};
+
+
+#endif // DFA_H
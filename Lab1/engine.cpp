@@ -1,5 +1,7 @@
 #include "engine.h"
+#include "matcher.h"
 
+#include <algorithm>
 #include <iostream>
 
 
@@ -15,11 +17,13 @@
  * finds it is unable to achieve matches.
  *
  * The function will attempt to find a match starting at the specific index
- * start.
+ * start.  The operators themselves are never modified; everything the
+ * algorithm needs to remember is kept in the context.
  *
  * If the function cannot generate a match, it will return the range (-1, -1).
  */
-Range findAtIndex(vector<RegexOperator *> regex, const string &s, int start) {
+Range findAtIndex(const vector<RegexOperator *> &regex, string_view s,
+                  int start, BacktrackContext &context) {
     if (VERBOSE) {
         cout << string(78, '-') << endl;
         cout << "Find regex in \"" << s << "\", starting at index " << start
@@ -27,17 +31,17 @@ Range findAtIndex(vector<RegexOperator *> regex, const string &s, int start) {
     }
     
     Range matched(start, start);
+    context.reset((int) regex.size());
 
     // Keep track of the parts of the regex we have applied, so that we can
     // figure out what needs backtracking.
-    vector<RegexOperator *> applied;
+    vector<int> &applied = context.getApplied();
     int opIndex = 0;
     while (opIndex < (int) regex.size()) {
         assert(opIndex == (int) applied.size());
         
         // Get the next operator to apply.
-        RegexOperator *op = regex[opIndex];
-        op->clearMatches();
+        const RegexOperator *op = regex[opIndex];
         
         Range currentOp(matched.end, matched.end);
 
@@ -45,26 +49,19 @@ Range findAtIndex(vector<RegexOperator *> regex, const string &s, int start) {
             cout << "Attempting to apply operator " << opIndex << endl;
 
         // Apply the operator as many times as possible, up to the maximum
-        // number of repetitions allowed.
-        int numMatches = 0;
-        while (op->getMaxRepeat() == -1 || numMatches < op->getMaxRepeat()) {
-            Range iter(currentOp.end, currentOp.end);
-            // If we get a match, record the range that we match on, so that
-            // we can backtrack if needed.
-            if (op->match(s, iter)) {
-                op->pushMatch(iter);
-
-                if (VERBOSE) {
-                    cout << " * Matched range [" << iter.start << ", "
-                         << iter.end << ")" << endl;
-                }
+        // number of repetitions allowed.  The whole run is found in one
+        // call, and recorded as a count so that we can backtrack if needed.
+        int limit = (int) s.length() - currentOp.end;
+        if (op->getMaxRepeat() != -1)
+            limit = min(limit, op->getMaxRepeat());
 
-                currentOp.end = iter.end;
-                numMatches++;
-            }
-            else {
-                break;
-            }
+        int numMatches = op->matchRun(s, currentOp.end, limit);
+        context.setMatches(opIndex, currentOp.start, numMatches);
+        currentOp.end += numMatches;
+
+        if (VERBOSE && numMatches > 0) {
+            cout << " * Matched range [" << currentOp.start << ", "
+                 << currentOp.end << ")" << endl;
         }
 
         // If we applied the operator at least as many times as required, then
@@ -77,7 +74,7 @@ Range findAtIndex(vector<RegexOperator *> regex, const string &s, int start) {
 
             // Record that the operator was applied, and update the
             // "matched range"
-            applied.push_back(op);
+            applied.push_back(opIndex);
             matched.end = currentOp.end;
             opIndex++;
         }
@@ -93,20 +90,22 @@ Range findAtIndex(vector<RegexOperator *> regex, const string &s, int start) {
             }
             
             while (!applied.empty()) {
-                RegexOperator *btOp = applied.back();
-                if (btOp->numMatches() > btOp->getMinRepeat()) {
+                int btIndex = applied.back();
+                const RegexOperator *btOp = regex[btIndex];
+                if (context.numMatches(btIndex) > btOp->getMinRepeat()) {
                     // The current operator has been applied more than the
                     // minimum number of times.  Remove one application of
                     // this operation, and retry from that point.
                     
                     if (VERBOSE) {
                         cout << " * Operator " << (opIndex - 1)
-                             << " has been applied " << btOp->numMatches()
+                             << " has been applied "
+                             << context.numMatches(btIndex)
                              << " times (" << btOp->getMinRepeat()
                              << " required); trying one less" << endl;
                     }
 
-                    Range popped = btOp->popMatch();
+                    Range popped = context.popMatch(btIndex);
                     currentOp.end = popped.start;
                     matched.end = popped.start;
 
@@ -150,11 +149,15 @@ Range findAtIndex(vector<RegexOperator *> regex, const string &s, int start) {
     
     return matched;
 }
-Range find(vector<RegexOperator *> regex, const string &s) {
-    for (int i = 0; i < s.length(); i++) {
-        string c = s.substr(i, 1);
 
-        auto range = (findAtIndex(regex, s, i));
+
+/* Find the first non-empty match in the string with the backtracking engine,
+ * by trying to match at each index in turn.
+ */
+Range findBacktrack(const vector<RegexOperator *> &regex, string_view s,
+                    BacktrackContext &context) {
+    for (int i = 0; i < (int) s.length(); i++) {
+        auto range = (findAtIndex(regex, s, i, context));
         if (!(range.start == range.end)) {
             return range;
         }
@@ -162,12 +165,117 @@ Range find(vector<RegexOperator *> regex, const string &s) {
     return Range(-1, -1);
 }
 
-bool match(vector<RegexOperator *> regex, const string &s) {
 
-    auto r = find(regex, s);
-    if (r.end > r.start && r.end == s.length() && r.start == 0) {
-        return true;
+/* Prepare to match a regex with the specified number of operators. */
+void BacktrackContext::reset(int numOperators) {
+    if ((int) counts.size() < numOperators) {
+        starts.resize(numOperators);
+        counts.resize(numOperators);
     }
-    return false;
+    applied.clear();
 }
 
+
+/* Records that the operator matched count times in a row, starting at the
+ * specified index.  Done each time the operator is tried at a new position.
+ */
+void BacktrackContext::setMatches(int opIndex, int start, int count) {
+    starts[opIndex] = start;
+    counts[opIndex] = count;
+}
+
+
+/* Reports how many times the operator has successfully matched. */
+int BacktrackContext::numMatches(int opIndex) const {
+    return counts[opIndex];
+}
+
+
+/* Removes the last match the operator successfully matched against.  Used for
+ * backtracking by the regex engine.
+ */
+Range BacktrackContext::popMatch(int opIndex) {
+    assert(counts[opIndex] > 0);
+    int end = starts[opIndex] + counts[opIndex];
+    counts[opIndex]--;
+    return Range(end - 1, end);
+}
+
+
+/* Returns the stack of applied operators. */
+vector<int> & BacktrackContext::getApplied() {
+    return applied;
+}
+
+
+/* Find the first non-empty match in the string.  This compiles the regex
+ * for a single search, and only for the engine that runs it, since a whole
+ * Regex costs more to build than a search of a short string.  To search
+ * with the same regex many times, or from many threads, compile it once
+ * into a Regex and give each thread a Matcher.
+ */
+Range find(const vector<RegexOperator *> &regex, string_view s,
+           Engine engine) {
+    switch (resolveEngine(regex, engine)) {
+    case Engine::PIKE_VM: {
+        NFAProgram prog(regex);
+        return PikeVM(prog).find(s);
+    }
+
+    case Engine::DFA: {
+        NFAProgram forward(regex), reverse(regex, /* reversed */ true);
+        return DFAEngine(forward, reverse).find(s);
+    }
+
+    case Engine::LITERAL:
+        return LiteralSearcher(regex).find(s);
+
+    case Engine::SHIFT_AND:
+        return ShiftAndSearcher(regex).find(s);
+
+    default: {
+        ByteProgram prog(regex);
+        return BytecodeVM(prog).find(s);
+    }
+    }
+}
+
+
+/* Reports whether the regex matches the entire string. */
+bool match(const vector<RegexOperator *> &regex, string_view s,
+           Engine engine) {
+    switch (resolveEngine(regex, engine)) {
+    case Engine::PIKE_VM: {
+        NFAProgram prog(regex);
+        return PikeVM(prog).match(s);
+    }
+
+    case Engine::DFA: {
+        NFAProgram forward(regex), reverse(regex, /* reversed */ true);
+        return DFAEngine(forward, reverse).match(s);
+    }
+
+    case Engine::LITERAL:
+        return LiteralSearcher(regex).match(s);
+
+    case Engine::SHIFT_AND:
+        return ShiftAndSearcher(regex).match(s);
+
+    default: {
+        ByteProgram prog(regex);
+        return BytecodeVM(prog).match(s);
+    }
+    }
+}
+
+
+Range find(const vector<RegexOperator *> &regex, const char *data,
+           size_t length, Engine engine) {
+    return find(regex, string_view(data, length), engine);
+}
+
+
+bool match(const vector<RegexOperator *> &regex, const char *data,
+           size_t length, Engine engine) {
+    return match(regex, string_view(data, length), engine);
+}
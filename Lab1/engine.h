@@ -1,6 +1,89 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
 #include "regex.h"
 
 
-Range find(vector<RegexOperator *> regex, const string &s);
-bool match(vector<RegexOperator *> regex, const string &s);
+/* The matching engines that find() and match() can use.
+ *
+ * BACKTRACK is the original backtracking algorithm, run over the regex
+ * compiled into bytecode.  It is fast on simple patterns, but can take
+ * exponential time on patterns with many repeated operators, unless the
+ * string is short enough for it to remember every state it has failed from.
+ * It only runs sequences of operators; a regex with groups or alternation
+ * uses the engine AUTO would pick.
+ *
+ * PIKE_VM compiles the regex into a Thompson NFA and simulates it with a
+ * Pike VM, which always runs in O(n * m) time.
+ *
+ * DFA runs the regex with lazily-built DFAs, which cost a single table lookup
+ * per character once their state cache is warm.  It falls back to the Pike
+ * VM if the state cache thrashes.
+ *
+ * LITERAL searches for the regex as a plain string with Boyer-Moore-Horspool.
+ * It only applies to regexes where every operator matches one specific
+ * character exactly once; any other regex uses the engine AUTO would pick.
+ *
+ * SHIFT_AND simulates the regex's Glushkov automaton with bit-parallel
+ * Shift-And, which keeps one bit per operator in a single machine word.  It
+ * only applies to regexes with at most 64 operators, each repeated once, ?,
+ * * or +; any other regex uses the engine AUTO would pick.
+ *
+ * AUTO uses the DFA for a regex with groups or alternation.  Otherwise, it
+ * uses LITERAL when it applies, the backtracking engine when the regex
+ * cannot backtrack at all (every operator has a fixed repeat count),
+ * SHIFT_AND when it applies, and the DFA otherwise.
+ *
+ * All engines report exactly the same ranges.
+ */
+enum class Engine { AUTO, BACKTRACK, PIKE_VM, DFA, LITERAL, SHIFT_AND };
+
+
+/* The state the backtracking engine keeps while it matches a regex: for each
+ * operator, where its run of repetitions starts and how many times it has
+ * matched, and the stack of operators that have been applied.  This lives
+ * outside the operators themselves, so that each thread matching a regex can
+ * have its own.
+ *
+ * Since every operator consumes exactly one character per repetition, the
+ * repetitions of an operator always cover [start, start + count), so the
+ * context takes O(1) memory per operator no matter how long the runs are.
+ * The vectors are cleared rather than freed between searches, so once a
+ * context has been used, reusing it doesn't allocate memory.
+ */
+class BacktrackContext {
+    vector<int> starts;
+    vector<int> counts;
+    vector<int> applied;
+
+public:
+    // Prepare to match a regex with the specified number of operators.
+    void reset(int numOperators);
+
+    // Operations to support backtracking, indexed by operator
+    void setMatches(int opIndex, int start, int count);
+    int numMatches(int opIndex) const;
+    Range popMatch(int opIndex);
+
+    // The indexes of the operators applied so far, in order
+    vector<int> & getApplied();
+};
+
+
+Range findAtIndex(const vector<RegexOperator *> &regex, string_view s,
+                  int start, BacktrackContext &context);
+Range findBacktrack(const vector<RegexOperator *> &regex, string_view s,
+                    BacktrackContext &context);
+
+Range find(const vector<RegexOperator *> &regex, string_view s,
+           Engine engine = Engine::AUTO);
+bool match(const vector<RegexOperator *> &regex, string_view s,
+           Engine engine = Engine::AUTO);
+
+Range find(const vector<RegexOperator *> &regex, const char *data,
+           size_t length, Engine engine = Engine::AUTO);
+bool match(const vector<RegexOperator *> &regex, const char *data,
+           size_t length, Engine engine = Engine::AUTO);
+
 
+#endif // ENGINE_H
@@ -0,0 +1,167 @@
+#include "grep.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+
+vector<string_view> splitLines(string_view text, size_t chunkSize) {
+    vector<string_view> chunks;
+    size_t begin = 0;
+    while (begin < text.length()) {
+        size_t end = begin + max<size_t>(chunkSize, 1);
+        if (end >= text.length()) {
+            end = text.length();
+        }
+        else {
+            size_t newline = text.find('\n', end - 1);
+            end = newline == string_view::npos ? text.length() : newline + 1;
+        }
+        chunks.push_back(text.substr(begin, end - begin));
+        begin = end;
+    }
+    return chunks;
+}
+
+
+/* Reports whether any character set of the regex's program can match a
+ * newline, in which case a match found in a run of lines may cross from one
+ * line to the next.
+ */
+static bool canMatchNewline(const Regex &regex) {
+    const NFAProgram &program = regex.getProgram();
+    for (int set = 0; set < program.numSets(); set++) {
+        if (program.getSet(set).contains('\n'))
+            return true;
+    }
+    return false;
+}
+
+
+/* Returns the index of the newline that ends the line containing index
+ * from, or the length of the text if it is the last line.
+ */
+static int lineEnd(string_view text, int from) {
+    const char *newline = (const char *) memchr(text.data() + from, '\n',
+                                                text.length() - from);
+    return newline == nullptr ? (int) text.length()
+                              : (int) (newline - text.data());
+}
+
+
+long grepLines(Matcher &matcher, string_view text,
+               const function<void(string_view)> &onLine) {
+    int length = (int) text.length();
+    long count = 0;
+
+    // Search each line on its own, if a match could cross lines.
+    if (canMatchNewline(matcher.getRegex())) {
+        for (int begin = 0; begin < length; ) {
+            int end = lineEnd(text, begin);
+            string_view line = text.substr(begin, end - begin);
+            if (matcher.find(line).start != -1) {
+                onLine(line);
+                count++;
+            }
+            begin = end + 1;
+        }
+        return count;
+    }
+
+    // Otherwise, search the whole text, and every match lies within one
+    // line.  The lines before it can't contain a match, since it is the
+    // leftmost one, so the search jumps straight from line to line.
+    for (int from = 0; from < length; ) {
+        Range r = matcher.findFrom(text, from);
+        if (r.start == -1)
+            break;
+
+        int begin = r.start;
+        while (begin > from && text[begin - 1] != '\n')
+            begin--;
+        int end = lineEnd(text, r.end);
+        onLine(text.substr(begin, end - begin));
+        count++;
+        from = end + 1;
+    }
+    return count;
+}
+
+
+long parallelGrep(const Regex &regex, string_view text,
+                  const GrepOptions &options,
+                  const function<void(const string &)> &write) {
+    vector<string_view> chunks = splitLines(text, options.chunkSize);
+
+    // The output and count of each chunk, filled in by the workers
+    struct ChunkResult {
+        string output;
+        long count = 0;
+        bool done = false;
+    };
+    vector<ChunkResult> results(chunks.size());
+
+    int numThreads = max(1, options.numThreads);
+    size_t window = 4 * (size_t) numThreads;
+
+    mutex lock;
+    condition_variable changed;
+    size_t next = 0, written = 0;
+
+    auto worker = [&]() {
+        Matcher matcher(regex);
+
+        for (;;) {
+            size_t i;
+            {
+                // Don't get too far ahead of the output.
+                unique_lock<mutex> guard(lock);
+                changed.wait(guard, [&]() {
+                    return next >= chunks.size() || next < written + window;
+                });
+                if (next >= chunks.size())
+                    return;
+                i = next++;
+            }
+
+            ChunkResult result;
+            auto onLine = [&](string_view line) {
+                if (!options.countOnly) {
+                    result.output += options.prefix;
+                    result.output += line;
+                    result.output += '\n';
+                }
+            };
+            result.count = grepLines(matcher, chunks[i], onLine);
+            result.done = true;
+
+            lock_guard<mutex> guard(lock);
+            results[i] = move(result);
+            changed.notify_all();
+        }
+    };
+
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; t++)
+        threads.emplace_back(worker);
+
+    long count = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        string output;
+        {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [&]() { return results[i].done; });
+            output = move(results[i].output);
+            count += results[i].count;
+            written = i + 1;
+            changed.notify_all();
+        }
+        if (!output.empty())
+            write(output);
+    }
+
+    for (thread &t : threads)
+        t.join();
+    return count;
+}
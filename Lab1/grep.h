@@ -0,0 +1,50 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include "matcher.h"
+
+#include <functional>
+
+
+/* Split the text into chunks of about chunkSize characters, each ending just
+ * after a newline, or at the end of the text, so that no line is split
+ * between two chunks.  A line longer than chunkSize gets a chunk to itself.
+ */
+vector<string_view> splitLines(string_view text, size_t chunkSize);
+
+
+/* Call onLine for every line of the text that contains a match, in order,
+ * without the newline at its end, and return the number of such lines.  The
+ * text must be shorter than 2 GB.
+ */
+long grepLines(Matcher &matcher, string_view text,
+               const function<void(string_view)> &onLine);
+
+
+struct GrepOptions {
+    // The number of worker threads, and the size of the chunks they search
+    int numThreads = 1;
+    size_t chunkSize = 4 << 20;
+
+    // Only count the matching lines, without building any output
+    bool countOnly = false;
+
+    // Written at the start of every line of output, such as a file name
+    string prefix;
+};
+
+
+/* Find the lines of the text that contain a match, the way grepLines() does,
+ * by splitting it into chunks with splitLines() and searching the chunks on
+ * a pool of worker threads, each with its own Matcher.  The output of each
+ * chunk, one matching line after another, is passed to write on the calling
+ * thread, in the original order; workers get only a few chunks ahead of the
+ * output, so memory use does not grow with the size of the text.  Returns
+ * the number of matching lines.
+ */
+long parallelGrep(const Regex &regex, string_view text,
+                  const GrepOptions &options,
+                  const function<void(const string &)> &write);
+
+
+#endif // GREP_H
@@ -0,0 +1,107 @@
+#include "literal.h"
+#include "prefilter.h"
+
+#include <cstring>
+
+
+LiteralSearcher::LiteralSearcher(const vector<RegexOperator *> &regex) {
+    for (const RegexOperator *op : regex) {
+        const MatchChar *mc = dynamic_cast<const MatchChar *>(op);
+        if (mc == nullptr || op->getMinRepeat() != 1 ||
+            op->getMaxRepeat() != 1) {
+            literal.clear();
+            break;
+        }
+        literal += mc->getChar();
+    }
+
+    // A window whose last character doesn't appear earlier in the literal
+    // can slide past it entirely; otherwise slide until the last earlier
+    // occurrence lines up with it.
+    int length = (int) literal.length();
+    for (int c = 0; c < 256; c++)
+        shift[c] = length;
+    for (int i = 0; i + 1 < length; i++)
+        shift[(unsigned char) literal[i]] = length - 1 - i;
+}
+
+
+bool LiteralSearcher::isActive() const {
+    return !literal.empty();
+}
+
+
+const string & LiteralSearcher::getLiteral() const {
+    return literal;
+}
+
+
+/* Returns the range of the literal if it occurs at the specified index, or
+ * the range (-1, -1) if it doesn't.
+ */
+Range LiteralSearcher::findAtIndex(string_view s, int start) const {
+    int length = (int) literal.length();
+    if (start + length <= (int) s.length() &&
+        s.compare(start, length, literal) == 0) {
+        return Range(start, start + length);
+    }
+    return Range(-1, -1);
+}
+
+
+/* Find the first occurrence of the literal at or after the specified index,
+ * or return the range (-1, -1) if there isn't one.
+ */
+Range LiteralSearcher::find(string_view s, int start) const {
+    if (!hasVectorLiteralSearch() || start > (int) s.length())
+        return findHorspool(s, start);
+
+    const char *begin = s.data();
+    const char *p = findLiteral(begin + start, begin + s.length(),
+                                literal.data(), (int) literal.length());
+    if (p == nullptr)
+        return Range(-1, -1);
+    int pos = (int) (p - begin);
+    return Range(pos, pos + (int) literal.length());
+}
+
+
+/* The same as find(), always using the Boyer-Moore-Horspool search. */
+Range LiteralSearcher::findHorspool(string_view s, int start) const {
+    const int length = (int) literal.length();
+    const int last = length - 1;
+    const char *needle = literal.data();
+    const char *begin = s.data();
+
+    if (start > (int) s.length())
+        return Range(-1, -1);
+
+    // memchr is already vectorized, and a skip table can't beat it when
+    // there is only one character to look for.
+    if (length == 1) {
+        const void *p = memchr(begin + start, needle[0], s.length() - start);
+        if (p == nullptr)
+            return Range(-1, -1);
+        int pos = (int) ((const char *) p - begin);
+        return Range(pos, pos + 1);
+    }
+
+    const char *end = begin + s.length();
+    const char *window = begin + start;
+    while (end - window >= length) {
+        unsigned char c = (unsigned char) window[last];
+        if (c == (unsigned char) needle[last] &&
+            memcmp(window, needle, last) == 0) {
+            int pos = (int) (window - begin);
+            return Range(pos, pos + length);
+        }
+        window += shift[c];
+    }
+    return Range(-1, -1);
+}
+
+
+/* Reports whether the string is exactly the literal. */
+bool LiteralSearcher::match(string_view s) const {
+    return s == literal;
+}
@@ -0,0 +1,39 @@
+#ifndef LITERAL_H
+#define LITERAL_H
+
+#include "regex.h"
+
+
+/* An engine for regexes that are nothing but a plain string: every operator
+ * matches one specific character exactly once.  Such a regex matches exactly
+ * where the string occurs, so no matching engine needs to run at all.
+ *
+ * The string is found with a Boyer-Moore-Horspool search, which compares the
+ * last character of each window first and skips ahead by up to the length of
+ * the string when it doesn't match.  When the processor has AVX2, the
+ * vectorized search from the prefilter is faster still, since it tests 32
+ * windows at once, so find() uses that instead.
+ */
+class LiteralSearcher {
+    string literal;
+
+    // How far to slide the window when its last character is c, indexed by
+    // unsigned char
+    int shift[256];
+
+public:
+    // The searcher is only active if every operator is a MatchChar with a
+    // repeat count of exactly one, and there is at least one operator.
+    LiteralSearcher(const vector<RegexOperator *> &regex);
+
+    bool isActive() const;
+    const string & getLiteral() const;
+
+    Range findAtIndex(string_view s, int start) const;
+    Range find(string_view s, int start = 0) const;
+    Range findHorspool(string_view s, int start = 0) const;
+    bool match(string_view s) const;
+};
+
+
+#endif // LITERAL_H
@@ -0,0 +1,401 @@
+#include "matcher.h"
+
+
+/* Choose the engine that Engine::AUTO should use for the regex.  A syntax
+ * tree can only be run by the automaton engines, of which the DFA is the
+ * fastest.
+ */
+static Engine chooseEngine(const SyntaxNode *syntax,
+                           const vector<RegexOperator *> &operators,
+                           bool literalActive, bool shiftAndActive) {
+    if (syntax != nullptr)
+        return Engine::DFA;
+
+    if (literalActive)
+        return Engine::LITERAL;
+
+    // Without a variable repeat count, the backtracking engine never has
+    // anything to backtrack over, so it runs in linear time per start index.
+    bool fixed = true;
+    for (const RegexOperator *op : operators) {
+        if (op->getMinRepeat() != op->getMaxRepeat())
+            fixed = false;
+    }
+    if (fixed)
+        return Engine::BACKTRACK;
+
+    return shiftAndActive ? Engine::SHIFT_AND : Engine::DFA;
+}
+
+
+/* Only the literal searcher is built, since it is cheap; whether the
+ * Shift-And engine applies is decided from the operators alone.
+ */
+Engine resolveEngine(const vector<RegexOperator *> &operators,
+                     Engine engine) {
+    bool literalActive = LiteralSearcher(operators).isActive();
+    bool shiftAndActive = ShiftAndSearcher::canSearch(operators);
+
+    if (engine == Engine::AUTO ||
+        (engine == Engine::LITERAL && !literalActive) ||
+        (engine == Engine::SHIFT_AND && !shiftAndActive))
+        return chooseEngine(nullptr, operators, literalActive,
+                            shiftAndActive);
+    return engine;
+}
+
+
+/* Compile the syntax tree if there is one, and the operators otherwise. */
+static NFAProgram compileProgram(const SyntaxNode *syntax,
+                                 const vector<RegexOperator *> &operators,
+                                 bool reversed) {
+    if (syntax != nullptr)
+        return NFAProgram(*syntax, reversed);
+    return NFAProgram(operators, reversed);
+}
+
+
+static PatternAnalysis analyze(const SyntaxNode *syntax,
+                               const vector<RegexOperator *> &operators) {
+    if (syntax != nullptr)
+        return PatternAnalysis(*syntax);
+    return PatternAnalysis(operators);
+}
+
+
+/* Only patterns with groups or alternation are parsed into a syntax tree,
+ * so that every other pattern can still use every engine.
+ */
+Regex::Regex(const string &pattern) :
+    syntax(hasGroups(pattern) ? parseSyntax(pattern) : nullptr),
+    parsedOperators(syntax ? vector<RegexOperator *>()
+                           : parseRegex(pattern, arena)),
+    operators(parsedOperators),
+    byteProgram(operators),
+    program(compileProgram(syntax.get(), operators, false)),
+    reverseProgram(compileProgram(syntax.get(), operators,
+                                  /* reversed */ true)),
+    analysis(analyze(syntax.get(), operators)),
+    prefilter(operators), literalSearcher(operators),
+    shiftAndSearcher(operators),
+    preferredEngine(chooseEngine(syntax.get(), operators,
+                                 literalSearcher.isActive(),
+                                 shiftAndSearcher.isActive())) {
+    // Nothing else to do.
+}
+
+
+Regex::Regex(const vector<RegexOperator *> &operators) :
+    operators(operators),
+    byteProgram(operators), program(operators),
+    reverseProgram(operators, /* reversed */ true), analysis(operators),
+    prefilter(operators), literalSearcher(operators),
+    shiftAndSearcher(operators),
+    preferredEngine(chooseEngine(nullptr, operators,
+                                 literalSearcher.isActive(),
+                                 shiftAndSearcher.isActive())) {
+    // Nothing else to do.
+}
+
+
+const vector<RegexOperator *> & Regex::getOperators() const {
+    return operators;
+}
+
+
+const SyntaxNode * Regex::getSyntax() const {
+    return syntax.get();
+}
+
+
+const ByteProgram & Regex::getByteProgram() const {
+    return byteProgram;
+}
+
+
+const NFAProgram & Regex::getProgram() const {
+    return program;
+}
+
+
+const NFAProgram & Regex::getReverseProgram() const {
+    return reverseProgram;
+}
+
+
+const PatternAnalysis & Regex::getAnalysis() const {
+    return analysis;
+}
+
+
+const LiteralPrefilter & Regex::getPrefilter() const {
+    return prefilter;
+}
+
+
+const LiteralSearcher & Regex::getLiteralSearcher() const {
+    return literalSearcher;
+}
+
+
+const ShiftAndSearcher & Regex::getShiftAndSearcher() const {
+    return shiftAndSearcher;
+}
+
+
+Engine Regex::getPreferredEngine() const {
+    return preferredEngine;
+}
+
+
+Matcher::Matcher(const Regex &regex, Engine engine, size_t dfaMemoryBudget) :
+    regex(regex), engine(engine), dfaMemoryBudget(dfaMemoryBudget),
+    bytecodeVM(regex.getByteProgram()), pikeVM(regex.getProgram()) {
+
+    if (engine == Engine::AUTO ||
+        (engine == Engine::BACKTRACK && regex.getSyntax() != nullptr) ||
+        (engine == Engine::LITERAL &&
+         !regex.getLiteralSearcher().isActive()) ||
+        (engine == Engine::SHIFT_AND &&
+         !regex.getShiftAndSearcher().isActive()))
+        this->engine = regex.getPreferredEngine();
+}
+
+
+/* Returns the DFA engine, building it if this is the first time it is used. */
+DFAEngine & Matcher::getDFA() {
+    if (!dfa) {
+        dfa.reset(new DFAEngine(regex.getProgram(), regex.getReverseProgram(),
+                                dfaMemoryBudget));
+    }
+    return *dfa;
+}
+
+
+/* Find the match starting at the specified index.  The match may be empty.
+ * If there is no match at the index, the range (-1, -1) is returned.
+ */
+Range Matcher::findAtIndex(string_view s, int start) {
+    switch (engine) {
+    case Engine::PIKE_VM:
+        return pikeVM.findAtIndex(s, start);
+
+    case Engine::DFA:
+        return getDFA().findAtIndex(s, start);
+
+    case Engine::LITERAL:
+        return regex.getLiteralSearcher().findAtIndex(s, start);
+
+    case Engine::SHIFT_AND:
+        return regex.getShiftAndSearcher().findAtIndex(s, start);
+
+    default:
+        return bytecodeVM.findAtIndex(s, start);
+    }
+}
+
+
+/* Returns the first index at or after from where a non-empty match could
+ * start, or -1 if there isn't one.  An index has to pass both the required
+ * literal and the pattern analysis; each one can move the index forward, so
+ * keep asking them in turn until they agree.
+ */
+int Matcher::nextStart(string_view s, int from, int &literalPos) const {
+    const LiteralPrefilter &prefilter = regex.getPrefilter();
+    const PatternAnalysis &analysis = regex.getAnalysis();
+
+    for (;;) {
+        int candidate = prefilter.nextCandidate(s, from, literalPos);
+        if (candidate == -1)
+            return -1;
+
+        from = analysis.nextStart(s, candidate);
+        if (from == candidate || from == -1)
+            return from;
+    }
+}
+
+
+/* Find the first non-empty match in the string.  If there is no match, the
+ * range (-1, -1) is returned.
+ */
+Range Matcher::find(string_view s) {
+    return findFrom(s, 0);
+}
+
+
+/* Find the first non-empty match in the string that starts at or after the
+ * specified index.  The range is relative to the start of the whole string,
+ * and is the same one find() would report for the rest of the string.
+ */
+Range Matcher::findFrom(string_view s, int from) {
+    int literalPos = -1;
+    return findFrom(s, from, literalPos);
+}
+
+
+/* The regex's required literal, first characters and minimum length are used
+ * to skip indexes where no match can start.  The backtracking engine only
+ * tries the candidate indexes; the automaton engines start scanning from the
+ * first candidate.  A regex that is just a plain string is searched for
+ * directly instead.  literalPos is the prefilter's position, kept by callers
+ * that search the same string repeatedly.
+ */
+Range Matcher::findFrom(string_view s, int from, int &literalPos) {
+    if (engine == Engine::LITERAL)
+        return regex.getLiteralSearcher().find(s, from);
+
+    int start = nextStart(s, from, literalPos);
+    if (start == -1)
+        return Range(-1, -1);
+
+    switch (engine) {
+    case Engine::PIKE_VM:
+        return pikeVM.find(s, start);
+
+    case Engine::DFA:
+        return getDFA().find(s, start);
+
+    case Engine::SHIFT_AND:
+        return regex.getShiftAndSearcher().find(s, start);
+
+    default:
+        break;
+    }
+
+    // The backtracking engine remembers the states that failed from one
+    // candidate to the next.
+    bytecodeVM.startSearch(s);
+    while (start != -1) {
+        Range r = bytecodeVM.tryIndex(s, start);
+        if (r.start != r.end)
+            return r;
+        start = nextStart(s, start + 1, literalPos);
+    }
+    return Range(-1, -1);
+}
+
+
+/* Reports whether the regex matches the entire string.  Strings of the wrong
+ * length, or that start with the wrong character, are rejected up front;
+ * otherwise only the match anchored at index 0 is tried, since no other
+ * match can cover the whole string.
+ */
+bool Matcher::match(string_view s) {
+    if (!regex.getAnalysis().canMatch(s))
+        return false;
+
+    switch (engine) {
+    case Engine::PIKE_VM:
+        return pikeVM.match(s);
+
+    case Engine::DFA:
+        return getDFA().match(s);
+
+    case Engine::LITERAL:
+        return regex.getLiteralSearcher().match(s);
+
+    case Engine::SHIFT_AND:
+        return regex.getShiftAndSearcher().match(s);
+
+    default:
+        return bytecodeVM.match(s);
+    }
+}
+
+
+Range Matcher::findAtIndex(const char *data, size_t length, int start) {
+    return findAtIndex(string_view(data, length), start);
+}
+
+
+Range Matcher::find(const char *data, size_t length) {
+    return find(string_view(data, length));
+}
+
+
+bool Matcher::match(const char *data, size_t length) {
+    return match(string_view(data, length));
+}
+
+
+/* Returns every non-overlapping match in the string, in order. */
+MatchRange Matcher::findAll(string_view s) {
+    return MatchRange(*this, s);
+}
+
+
+const Regex & Matcher::getRegex() const {
+    return regex;
+}
+
+
+DFAStats Matcher::getDFAStats() const {
+    if (!dfa)
+        return DFAStats();
+    return dfa->getStats();
+}
+
+
+MatchIterator::MatchIterator() : matcher(nullptr), current(-1, -1),
+    literalPos(-1) {
+    // Nothing else to do.
+}
+
+
+MatchIterator::MatchIterator(Matcher &matcher, string_view s) :
+    matcher(&matcher), s(s), current(-1, -1), literalPos(-1) {
+
+    current = matcher.findFrom(s, 0, literalPos);
+    if (current.start == -1)
+        this->matcher = nullptr;
+}
+
+
+const Range & MatchIterator::operator*() const {
+    return current;
+}
+
+
+const Range * MatchIterator::operator->() const {
+    return &current;
+}
+
+
+/* Advance to the next match, which starts where the current one ends. */
+MatchIterator & MatchIterator::operator++() {
+    assert(matcher != nullptr);
+    current = matcher->findFrom(s, current.end, literalPos);
+    if (current.start == -1)
+        matcher = nullptr;
+    return *this;
+}
+
+
+bool MatchIterator::operator==(const MatchIterator &other) const {
+    if (matcher == nullptr || other.matcher == nullptr)
+        return matcher == other.matcher;
+    return current.start == other.current.start &&
+        current.end == other.current.end;
+}
+
+
+bool MatchIterator::operator!=(const MatchIterator &other) const {
+    return !(*this == other);
+}
+
+
+MatchRange::MatchRange(Matcher &matcher, string_view s) :
+    matcher(matcher), s(s) {
+    // Nothing else to do.
+}
+
+
+MatchIterator MatchRange::begin() const {
+    return MatchIterator(matcher, s);
+}
+
+
+MatchIterator MatchRange::end() const {
+    return MatchIterator();
+}
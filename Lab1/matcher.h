@@ -0,0 +1,187 @@
+#ifndef MATCHER_H
+#define MATCHER_H
+
+#include "analysis.h"
+#include "bytecode.h"
+#include "dfa.h"
+#include "engine.h"
+#include "literal.h"
+#include "nfa.h"
+#include "prefilter.h"
+#include "shiftand.h"
+
+#include <iterator>
+#include <memory>
+
+
+/* A compiled regular expression: the parsed operators, plus the programs the
+ * engines run.  A Regex is immutable once it is constructed, so a single
+ * Regex may be shared by any number of threads, as long as each thread does
+ * its matching through its own Matcher.
+ *
+ * A pattern with groups or alternation is parsed into a syntax tree instead
+ * of operators, and compiled into programs for the automaton engines only;
+ * its list of operators is empty.
+ */
+class Regex {
+    // The syntax tree, for a pattern with groups or alternation
+    unique_ptr<SyntaxNode> syntax;
+
+    // Holds the operators, when the Regex parsed them itself
+    RegexArena arena;
+    vector<RegexOperator *> parsedOperators;
+
+    // The operators the Regex was compiled from, which are either the
+    // parsed operators or the caller's
+    const vector<RegexOperator *> &operators;
+
+    ByteProgram byteProgram;
+    NFAProgram program;
+    NFAProgram reverseProgram;
+
+    PatternAnalysis analysis;
+    LiteralPrefilter prefilter;
+    LiteralSearcher literalSearcher;
+    ShiftAndSearcher shiftAndSearcher;
+    Engine preferredEngine;
+
+public:
+    // Parse and compile the pattern.  The Regex owns the parsed operators,
+    // which are all kept in one block.
+    Regex(const string &pattern);
+
+    // Compile operators produced by parseRegex().  The vector and the
+    // operators are not copied or owned by the Regex, and must outlive it.
+    Regex(const vector<RegexOperator *> &operators);
+
+    // A temporary vector would be gone before the Regex is used.
+    Regex(vector<RegexOperator *> &&operators) = delete;
+
+    Regex(const Regex &other) = delete;
+    Regex & operator=(const Regex &other) = delete;
+
+    const vector<RegexOperator *> & getOperators() const;
+
+    // The syntax tree, or null if the regex is a sequence of operators
+    const SyntaxNode * getSyntax() const;
+
+    const ByteProgram & getByteProgram() const;
+    const NFAProgram & getProgram() const;
+    const NFAProgram & getReverseProgram() const;
+    const PatternAnalysis & getAnalysis() const;
+    const LiteralPrefilter & getPrefilter() const;
+    const LiteralSearcher & getLiteralSearcher() const;
+    const ShiftAndSearcher & getShiftAndSearcher() const;
+
+    // The engine that Engine::AUTO resolves to for this regex
+    Engine getPreferredEngine() const;
+};
+
+
+// The engine a Matcher over the operators runs when asked for the engine:
+// AUTO, and engines that don't apply to the operators, resolve to the one
+// AUTO picks.  Works this out without compiling the operators.
+Engine resolveEngine(const vector<RegexOperator *> &operators, Engine engine);
+
+
+class MatchRange;
+
+
+/* The scratch state needed to match a Regex against strings.  A Matcher may
+ * be reused for any number of searches, but may only be used by one thread
+ * at a time.
+ */
+class Matcher {
+    const Regex &regex;
+    Engine engine;
+    size_t dfaMemoryBudget;
+
+    BytecodeVM bytecodeVM;
+    PikeVM pikeVM;
+
+    // Built on first use, since its caches take a while to set up
+    unique_ptr<DFAEngine> dfa;
+
+    DFAEngine & getDFA();
+    int nextStart(string_view s, int from, int &literalPos) const;
+    Range findFrom(string_view s, int from, int &literalPos);
+
+    friend class MatchIterator;
+
+public:
+    Matcher(const Regex &regex, Engine engine = Engine::AUTO,
+            size_t dfaMemoryBudget = LazyDFA::DEFAULT_MEMORY_BUDGET);
+
+    Range findAtIndex(string_view s, int start);
+    Range find(string_view s);
+    Range findFrom(string_view s, int from);
+    bool match(string_view s);
+
+    // Every non-empty match, without overlaps, as a range to iterate over
+    MatchRange findAll(string_view s);
+
+    // The same, for input that isn't in a string
+    Range findAtIndex(const char *data, size_t length, int start);
+    Range find(const char *data, size_t length);
+    bool match(const char *data, size_t length);
+
+    const Regex & getRegex() const;
+
+    // Counters from the DFA engine, if it has been used
+    DFAStats getDFAStats() const;
+};
+
+
+/* An input iterator over the successive matches of a regex in a string.
+ * Each search resumes where the previous match ended, in the same string, so
+ * nothing is copied, the ranges are relative to the start of the string, and
+ * the prefilter's position and the DFA's cached states carry over from one
+ * match to the next.
+ *
+ * find() never reports empty matches, so every match ends after the one
+ * before it, and the iteration always makes progress.
+ */
+class MatchIterator {
+    Matcher *matcher;
+    string_view s;
+    Range current;
+    int literalPos;
+
+public:
+    using iterator_category = input_iterator_tag;
+    using value_type = Range;
+    using difference_type = ptrdiff_t;
+    using pointer = const Range *;
+    using reference = const Range &;
+
+    // The iterator past the last match
+    MatchIterator();
+
+    // The iterator at the first match in the string
+    MatchIterator(Matcher &matcher, string_view s);
+
+    const Range & operator*() const;
+    const Range * operator->() const;
+    MatchIterator & operator++();
+
+    bool operator==(const MatchIterator &other) const;
+    bool operator!=(const MatchIterator &other) const;
+};
+
+
+/* The matches returned by Matcher::findAll(), for use in a range-based for
+ * loop.  The string and the Matcher must outlive it.
+ */
+class MatchRange {
+    Matcher &matcher;
+    string_view s;
+
+public:
+    MatchRange(Matcher &matcher, string_view s);
+
+    MatchIterator begin() const;
+    MatchIterator end() const;
+};
+
+
+#endif // MATCHER_H
@@ -0,0 +1,559 @@
+#include "nfa.h"
+
+#include <algorithm>
+#include <utility>
+
+
+/* Compile a sequence of regex operators into a Thompson NFA.  Each operator
+ * is emitted as a repetition of a single CONSUME instruction; see
+ * emitRepeat().  A reversed program takes the operators in reverse order,
+ * for matching backward.
+ */
+NFAProgram::NFAProgram(const vector<RegexOperator *> &regex, bool reversed) {
+    emitOperators(regex, reversed);
+    emit(NFAInst::MATCH, -1, 0);
+}
+
+
+/* Compile a syntax tree into a Thompson NFA.  A reversed program matches the
+ * reverse of every string the tree matches, for matching backward.
+ */
+NFAProgram::NFAProgram(const SyntaxNode &syntax, bool reversed) {
+    emitNode(syntax, reversed);
+    emit(NFAInst::MATCH, -1, 0);
+}
+
+
+/* Combine several programs into one that matches any of them.  It starts
+ * with a chain of SPLIT instructions, one branch per program, followed by a
+ * copy of each program with its instructions, character sets and counters
+ * renumbered.  The MATCH instruction at the end of each program's copy
+ * records the index of the program in x.
+ */
+NFAProgram::NFAProgram(const vector<const NFAProgram *> &programs) {
+    int numPrograms = (int) programs.size();
+    for (int k = 0; k + 1 < numPrograms; k++)
+        emit(NFAInst::SPLIT);
+
+    for (int k = 0; k < numPrograms; k++) {
+        // Point the chain at the first instruction of this program.
+        int start = (int) insts.size();
+        if (k + 1 < numPrograms)
+            insts[k].x = start;
+        if (k > 0)
+            insts[k - 1].y = k + 1 < numPrograms ? k : start;
+
+        const NFAProgram &prog = *programs[k];
+        int setBase = (int) sets.size();
+        int counterBase = (int) counters.size();
+
+        for (NFAInst inst : prog.insts) {
+            if (inst.opcode == NFAInst::MATCH) {
+                inst.x = k;
+            }
+            else {
+                if (inst.set != -1)
+                    inst.set += setBase;
+                if (inst.x != -1)
+                    inst.x += start;
+                if (inst.y != -1)
+                    inst.y += start;
+                if (inst.counter != -1)
+                    inst.counter += counterBase;
+            }
+            insts.push_back(inst);
+        }
+        sets.insert(sets.end(), prog.sets.begin(), prog.sets.end());
+        counters.insert(counters.end(), prog.counters.begin(),
+                        prog.counters.end());
+    }
+}
+
+
+/* Append the instructions for minRepeat to maxRepeat greedy repetitions of
+ * the instructions emitBody() appends.  ?, * and + are loops of SPLIT and
+ * JMP instructions; any other count is a loop with a counter, so the body is
+ * emitted once, however large the count.
+ */
+template <typename EmitBody>
+void NFAProgram::emitRepeat(int minRepeat, int maxRepeat,
+                            EmitBody emitBody) {
+    int loop = (int) insts.size();
+
+    if (maxRepeat == 0)
+        return;
+
+    if (minRepeat == 1 && maxRepeat == 1) {
+        emitBody();
+    }
+    else if (minRepeat == 0 && maxRepeat == 1) {
+        // L:   SPLIT L+1, end
+        // L+1: body
+        emit(NFAInst::SPLIT, -1, loop + 1);
+        emitBody();
+        insts[loop].y = (int) insts.size();
+    }
+    else if (minRepeat == 0 && maxRepeat == -1) {
+        // L:   SPLIT L+1, end
+        // L+1: body
+        //      JMP L
+        emit(NFAInst::SPLIT, -1, loop + 1);
+        emitBody();
+        emit(NFAInst::JMP, -1, loop);
+        insts[loop].y = (int) insts.size();
+    }
+    else if (minRepeat == 1 && maxRepeat == -1) {
+        // L:   body
+        //      SPLIT L, end
+        emitBody();
+        emit(NFAInst::SPLIT, -1, loop, (int) insts.size() + 1);
+    }
+    else {
+        // L:   REPEAT L+1, end
+        // L+1: body
+        //      INCR L
+        int counter = (int) counters.size();
+        counters.push_back(NFACounter{minRepeat, maxRepeat});
+
+        emit(NFAInst::REPEAT, -1, loop + 1, -1, counter);
+        emitBody();
+        emit(NFAInst::INCR, -1, loop, -1, counter);
+        insts[loop].y = (int) insts.size();
+    }
+}
+
+
+/* Append the instructions for a sequence of operators. */
+void NFAProgram::emitOperators(const vector<RegexOperator *> &regex,
+                               bool reversed) {
+    int numOps = (int) regex.size();
+    for (int k = 0; k < numOps; k++) {
+        const RegexOperator *op = regex[reversed ? numOps - 1 - k : k];
+
+        int set = (int) sets.size();
+        sets.push_back(op->getMatchingChars());
+
+        emitRepeat(op->getMinRepeat(), op->getMaxRepeat(), [&]() {
+            emit(NFAInst::CONSUME, set);
+        });
+    }
+}
+
+
+/* Append the instructions for a node of a syntax tree and its children.
+ * Each alternative but the last starts with a SPLIT that prefers it to the
+ * alternatives after it, and ends with a JMP past the rest; the targets are
+ * patched once we know where they are.
+ */
+void NFAProgram::emitNode(const SyntaxNode &node, bool reversed) {
+    int numChildren = (int) node.children.size();
+
+    switch (node.kind) {
+    case SyntaxNode::CHARS:
+        sets.push_back(node.chars);
+        emit(NFAInst::CONSUME, (int) sets.size() - 1);
+        break;
+
+    case SyntaxNode::CONCAT:
+        for (int k = 0; k < numChildren; k++) {
+            int child = reversed ? numChildren - 1 - k : k;
+            emitNode(*node.children[child], reversed);
+        }
+        break;
+
+    case SyntaxNode::ALTERNATE: {
+        vector<int> jumps;
+        for (int k = 0; k < numChildren; k++) {
+            int split = (int) insts.size();
+            if (k + 1 < numChildren)
+                emit(NFAInst::SPLIT, -1, split + 1);
+
+            emitNode(*node.children[k], reversed);
+
+            if (k + 1 < numChildren) {
+                jumps.push_back((int) insts.size());
+                emit(NFAInst::JMP);
+                insts[split].y = (int) insts.size();
+            }
+        }
+
+        for (int pc : jumps)
+            insts[pc].x = (int) insts.size();
+        break;
+    }
+
+    case SyntaxNode::REPEAT:
+        emitRepeat(node.minRepeat, node.maxRepeat, [&]() {
+            emitNode(*node.children[0], reversed);
+        });
+        break;
+    }
+}
+
+
+/* Append an instruction to the end of the program. */
+void NFAProgram::emit(NFAInst::Opcode opcode, int set, int x, int y,
+                      int counter) {
+    insts.push_back(NFAInst{opcode, set, x, y, counter});
+}
+
+
+/* Returns the number of instructions in the program. */
+int NFAProgram::size() const {
+    return (int) insts.size();
+}
+
+
+/* Returns the instruction at the specified program counter. */
+const NFAInst & NFAProgram::operator[](int pc) const {
+    assert(pc >= 0 && pc < (int) insts.size());
+    return insts[pc];
+}
+
+
+/* Returns the number of character sets in the program. */
+int NFAProgram::numSets() const {
+    return (int) sets.size();
+}
+
+
+/* Returns the character set with the specified index. */
+const CharSet & NFAProgram::getSet(int set) const {
+    assert(set >= 0 && set < (int) sets.size());
+    return sets[set];
+}
+
+
+/* Returns the number of counters in the program. */
+int NFAProgram::numCounters() const {
+    return (int) counters.size();
+}
+
+
+/* Returns the repeat counts of the counter with the specified index. */
+const NFACounter & NFAProgram::getCounter(int counter) const {
+    assert(counter >= 0 && counter < (int) counters.size());
+    return counters[counter];
+}
+
+
+/* Push a copy of the thread, moved to pc, and return where it starts in
+ * the stack.
+ */
+int NFAProgram::pushThread(vector<int> &stack, int pc,
+                           const int *thread) const {
+    int at = (int) stack.size();
+    stack.push_back(pc);
+    stack.insert(stack.end(), thread + 1, thread + threadSize());
+    return at;
+}
+
+
+void NFAProgram::follow(const int *thread, vector<int> &stack) const {
+    const NFAInst &inst = insts[thread[0]];
+
+    switch (inst.opcode) {
+    case NFAInst::JMP:
+        pushThread(stack, inst.x, thread);
+        break;
+
+    case NFAInst::SPLIT:
+        pushThread(stack, inst.y, thread);
+        pushThread(stack, inst.x, thread);
+        break;
+
+    case NFAInst::REPEAT: {
+        const NFACounter &limits = counters[inst.counter];
+        int count = thread[1 + inst.counter];
+
+        if (count >= limits.minRepeat) {
+            int at = pushThread(stack, inst.y, thread);
+            stack[at + 1 + inst.counter] = 0;
+        }
+        if (limits.maxRepeat == -1 || count < limits.maxRepeat)
+            pushThread(stack, inst.x, thread);
+        break;
+    }
+
+    case NFAInst::INCR: {
+        const NFACounter &limits = counters[inst.counter];
+        int most = limits.maxRepeat == -1 ? limits.minRepeat
+                                          : limits.maxRepeat;
+
+        int at = pushThread(stack, inst.x, thread);
+        int &count = stack[at + 1 + inst.counter];
+        count = min(count + 1, most);
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+
+template <typename Offset>
+NFAThreadList<Offset>::NFAThreadList(const NFAProgram &prog) :
+    prog(&prog), generation(0), record(prog.threadSize()) {
+    if (prog.numCounters() > 0)
+        rehash(16);
+    reset();
+}
+
+
+template <typename Offset>
+void NFAThreadList<Offset>::reset() {
+    clear();
+    lastAdded.assign(prog->size(), -1);
+    visitedAt = -1;
+}
+
+
+template <typename Offset>
+void NFAThreadList<Offset>::clear() {
+    threads.clear();
+    counts.clear();
+}
+
+
+template <typename Offset>
+void NFAThreadList<Offset>::swap(NFAThreadList &other) {
+    threads.swap(other.threads);
+    lastAdded.swap(other.lastAdded);
+    counts.swap(other.counts);
+    visited.swap(other.visited);
+    table.swap(other.table);
+    std::swap(generation, other.generation);
+    std::swap(visitedAt, other.visitedAt);
+}
+
+
+/* Add a thread by following JMP and SPLIT instructions depth first, in the
+ * order they prefer their branches, so that the threads are added in
+ * priority order.
+ */
+template <typename Offset>
+void NFAThreadList<Offset>::add(const int *thread, Offset start,
+                                Offset position) {
+    if (prog->numCounters() > 0) {
+        addCounted(thread, start, position);
+        return;
+    }
+
+    stack.clear();
+    stack.push_back(thread[0]);
+
+    while (!stack.empty()) {
+        int pc = stack.back();
+        stack.pop_back();
+
+        if (lastAdded[pc] == position)
+            continue;
+        lastAdded[pc] = position;
+
+        const NFAInst &inst = (*prog)[pc];
+        switch (inst.opcode) {
+        case NFAInst::JMP:
+            stack.push_back(inst.x);
+            break;
+
+        case NFAInst::SPLIT:
+            // Push the preferred branch last, so that it is explored first.
+            stack.push_back(inst.y);
+            stack.push_back(inst.x);
+            break;
+
+        case NFAInst::CONSUME:
+        case NFAInst::MATCH:
+            threads.push_back(Thread{pc, start});
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+
+/* Hash a thread record of a program with counters. */
+static inline size_t hashThread(const int *thread, int size) {
+    uint32_t h = 0;
+    for (int k = 0; k < size; k++)
+        h = (h ^ (uint32_t) thread[k]) * 0x9e3779b1u;
+    return h ^ (h >> 15);
+}
+
+
+/* Make the hash table numSlots slots long, a power of two, keeping the
+ * records visited at the current position.
+ */
+template <typename Offset>
+void NFAThreadList<Offset>::rehash(size_t numSlots) {
+    int size = prog->threadSize();
+    table.assign(numSlots, Slot{0, 0});
+    if (++generation == 0)
+        generation = 1;
+
+    size_t mask = numSlots - 1;
+    for (size_t k = 0; k < visited.size(); k += size) {
+        size_t j = hashThread(&visited[k], size) & mask;
+        while (table[j].generation == generation)
+            j = (j + 1) & mask;
+        table[j] = Slot{generation, (int) k};
+    }
+}
+
+
+/* Mark the thread record as visited at the position, and report whether it
+ * wasn't already.
+ */
+template <typename Offset>
+bool NFAThreadList<Offset>::visit(const int *thread, Offset position) {
+    int size = prog->threadSize();
+    if (visitedAt != position) {
+        visitedAt = position;
+        visited.clear();
+        if (++generation == 0) {
+            // The generation has wrapped around, so old slots could look
+            // current.
+            table.assign(table.size(), Slot{0, 0});
+            generation = 1;
+        }
+    }
+
+    // Keep the table at most half full.
+    if (2 * (visited.size() + size) > table.size() * size)
+        rehash(2 * table.size());
+
+    size_t mask = table.size() - 1;
+    for (size_t j = hashThread(thread, size) & mask;; j = (j + 1) & mask) {
+        Slot &slot = table[j];
+        if (slot.generation != generation) {
+            slot = Slot{generation, (int) visited.size()};
+            visited.insert(visited.end(), thread, thread + size);
+            return true;
+        }
+        if (equal(thread, thread + size, visited.begin() + slot.index))
+            return false;
+    }
+}
+
+
+/* Add a thread of a program with counters, where each thread is a record of
+ * its instruction and counter values.  An instruction may be visited once
+ * for each combination of counter values.
+ */
+template <typename Offset>
+void NFAThreadList<Offset>::addCounted(const int *thread, Offset start,
+                                       Offset position) {
+    int size = prog->threadSize();
+    stack.assign(thread, thread + size);
+
+    while (!stack.empty()) {
+        // Move the thread off the stack, so that follow() can push the
+        // threads it continues to.
+        current.assign(stack.end() - size, stack.end());
+        stack.resize(stack.size() - size);
+        int pc = current[0];
+        if (!visit(current.data(), position))
+            continue;
+
+        const NFAInst &inst = (*prog)[pc];
+        if (inst.opcode == NFAInst::CONSUME ||
+            inst.opcode == NFAInst::MATCH) {
+            threads.push_back(Thread{pc, start});
+            counts.insert(counts.end(), current.begin() + 1, current.end());
+        }
+        else {
+            prog->follow(current.data(), stack);
+        }
+    }
+}
+
+
+template class NFAThreadList<int>;
+template class NFAThreadList<int64_t>;
+
+
+PikeVM::PikeVM(const NFAProgram &prog) : prog(prog),
+    initial(prog.threadSize(), 0), clist(prog), nlist(prog) {
+    // Nothing else to do.
+}
+
+
+/* Run the program over the input string, beginning at index start.  If
+ * anchored is true, only matches beginning at index start are considered, and
+ * the preferred match is reported even if it is empty.  Otherwise, a new
+ * thread is started at every index (at the lowest priority), and empty
+ * matches are ignored, just as find() ignores them.  If whole is true, the
+ * run is anchored, and only a match of the whole string is reported,
+ * whether or not it is the preferred one.
+ *
+ * If no match is found, the range (-1, -1) is returned.
+ */
+Range PikeVM::run(string_view s, int start, bool anchored, bool whole) {
+    int length = (int) s.length();
+    Range matched(-1, -1);
+
+    clist.reset();
+    nlist.reset();
+
+    for (int i = start; i <= length; i++) {
+        // Start a new thread at this index, if we are still looking for a
+        // starting point.  It has lower priority than every thread that
+        // started earlier.
+        if (matched.start == -1) {
+            if (anchored ? i == start : i < length) {
+                clist.add(initial.data(), i, i);
+            }
+        }
+
+        if (clist.empty()) {
+            if (anchored || matched.start != -1)
+                break;
+            continue;
+        }
+
+        int c = i < length ? (unsigned char) s[i] : -1;
+        clist.step(c, i + 1, nlist,
+                   [&](const NFAThreadList<int>::Thread &t) {
+            if ((!anchored && t.start == i) || (whole && i < length))
+                return false;
+
+            // Record the match, and cut off all lower-priority threads.
+            matched = Range(t.start, i);
+            return true;
+        });
+
+        clist.swap(nlist);
+        nlist.clear();
+    }
+
+    return matched;
+}
+
+
+/* Find the match that the backtracking engine would find starting at the
+ * specified index.  The match may be empty.
+ */
+Range PikeVM::findAtIndex(string_view s, int start) {
+    return run(s, start, /* anchored */ true);
+}
+
+
+/* Find the first non-empty match in the string that starts at or after the
+ * specified index.
+ */
+Range PikeVM::find(string_view s, int start) {
+    return run(s, start, /* anchored */ false);
+}
+
+
+/* Reports whether the regex matches the entire string.  This is the case
+ * if any way of matching the regex covers the string, even if the preferred
+ * match is shorter.
+ */
+bool PikeVM::match(string_view s) {
+    Range r = run(s, 0, /* anchored */ true, /* whole */ true);
+    return r.end > r.start && r.end == (int) s.length();
+}
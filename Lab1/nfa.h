@@ -0,0 +1,258 @@
+#ifndef NFA_H
+#define NFA_H
+
+#include "syntax.h"
+
+#include <algorithm>
+#include <cstdint>
+
+
+/* A single instruction of a compiled Thompson NFA.
+ *
+ * CONSUME instructions consume one character of input if it is in the
+ * referenced character set, and then continue at the next instruction.
+ * SPLIT instructions fork execution to both x and y, preferring x.  JMP
+ * instructions continue execution at x.  MATCH instructions report that the
+ * regex has matched, and hold the index of the regex in x, for programs
+ * compiled from more than one.
+ *
+ * REPEAT and INCR instructions run a counted repetition, such as (ab){2,5},
+ * with a counter of the iterations completed so far, rather than a copy of
+ * the repeated instructions for each iteration.  REPEAT is the head of the
+ * loop: it continues into the body at x if the counter is below the
+ * maximum, and leaves the loop for y if it has reached the minimum,
+ * preferring x.  Leaving sets the counter back to zero, so it is always
+ * zero when the loop is entered.  INCR ends the body: it adds one to the
+ * counter, and continues at x, the REPEAT.  Once the counter of a loop with
+ * no maximum reaches the minimum, it stays there, since more iterations
+ * make no difference; so each counter only takes a few distinct values.
+ */
+struct NFAInst {
+    enum Opcode { CONSUME, SPLIT, JMP, MATCH, REPEAT, INCR };
+
+    Opcode opcode;
+
+    // The index of the character set, for CONSUME instructions
+    int set;
+
+    // Branch targets for SPLIT, JMP, REPEAT and INCR instructions, and the
+    // index of the regex for MATCH instructions
+    int x, y;
+
+    // The index of the counter, for REPEAT and INCR instructions
+    int counter;
+};
+
+
+/* The repeat counts of a counted repetition, with the same meaning as for
+ * a RegexOperator.
+ */
+struct NFACounter {
+    int minRepeat, maxRepeat;
+};
+
+
+/* A Thompson NFA compiled from the operators produced by parseRegex(), or
+ * from the syntax tree produced by parseSyntax().  The characters each
+ * operator accepts are copied into the program as bitmaps, so the operators
+ * are not needed once the program has been compiled.
+ *
+ * Repetitions are compiled greedily, so that the order in which SPLIT
+ * instructions prefer their branches mirrors the order in which the
+ * backtracking engine tries alternatives.  Alternatives are preferred in
+ * the order they are written.
+ *
+ * A thread of a program with counters is more than an instruction: it is a
+ * record of the program counter followed by the value of each counter.
+ * Records take threadSize() ints; in a program without counters, that is
+ * just the program counter.
+ */
+class NFAProgram {
+    vector<NFAInst> insts;
+    vector<CharSet> sets;
+    vector<NFACounter> counters;
+
+    void emit(NFAInst::Opcode opcode, int set = -1, int x = -1, int y = -1,
+              int counter = -1);
+    template <typename EmitBody>
+    void emitRepeat(int minRepeat, int maxRepeat, EmitBody emitBody);
+    void emitOperators(const vector<RegexOperator *> &regex, bool reversed);
+    void emitNode(const SyntaxNode &node, bool reversed);
+
+    int pushThread(vector<int> &stack, int pc, const int *thread) const;
+
+public:
+    NFAProgram(const vector<RegexOperator *> &regex, bool reversed = false);
+    NFAProgram(const SyntaxNode &syntax, bool reversed = false);
+
+    // Combine several programs into one that matches any of them
+    NFAProgram(const vector<const NFAProgram *> &programs);
+
+    int size() const;
+    const NFAInst & operator[](int pc) const;
+
+    int numSets() const;
+    const CharSet & getSet(int set) const;
+
+    int numCounters() const;
+    const NFACounter & getCounter(int counter) const;
+
+    // The number of ints in a thread record
+    int threadSize() const {
+        return 1 + (int) counters.size();
+    }
+
+    // Push the records of the threads that the thread continues to without
+    // consuming input, in reverse priority order, so that the preferred one
+    // is popped first.  The thread must be at a SPLIT, JMP, REPEAT or INCR
+    // instruction, and must not be in the stack.
+    void follow(const int *thread, vector<int> &stack) const;
+};
+
+
+/* The threads of an NFAProgram at one position of the input, in priority
+ * order, as a Pike VM keeps them.  A thread is an instruction to execute,
+ * plus the position at which the thread started matching, an Offset: an
+ * int for a string, or an int64_t for a stream.
+ *
+ * Adding a thread follows SPLIT, JMP, REPEAT and INCR instructions, so that
+ * only CONSUME and MATCH instructions end up in the list, with
+ * constant-time membership tests by program counter.  In a program with
+ * counters, the counter values of each thread are kept in counts, and the
+ * records visited at the current position in a hash table, so that the
+ * membership test stays constant-time however many combinations of counter
+ * values are live.
+ *
+ * The members other than step() are compiled in nfa.cpp, for int and
+ * int64_t offsets only.
+ */
+template <typename Offset>
+class NFAThreadList {
+public:
+    struct Thread {
+        int pc;
+        Offset start;
+    };
+
+private:
+    const NFAProgram *prog;
+
+    vector<Thread> threads;
+    vector<Offset> lastAdded;
+    vector<int> counts;
+
+    // In a program with counters, the records visited at visitedAt, and an
+    // open-addressing hash table of their indexes in visited.  A slot is
+    // empty unless it holds the current generation, which changes with the
+    // position, so the table is never cleared.
+    struct Slot {
+        unsigned generation;
+        int index;
+    };
+    vector<int> visited;
+    vector<Slot> table;
+    unsigned generation;
+    Offset visitedAt;
+
+    // Scratch space, kept so that adding threads doesn't allocate
+    vector<int> stack;
+    vector<int> record, current;
+
+    bool visit(const int *thread, Offset position);
+    void rehash(size_t numSlots);
+    void addCounted(const int *thread, Offset start, Offset position);
+
+public:
+    NFAThreadList(const NFAProgram &prog);
+
+    // Forget the threads, and the positions at which instructions were
+    // visited, ready for a new search.
+    void reset();
+
+    // Empty the list, ready for the threads at another position.
+    void clear();
+
+    // Exchange the threads with another list's, without copying them.
+    void swap(NFAThreadList &other);
+
+    bool empty() const {
+        return threads.empty();
+    }
+
+    // Add a thread, a record of threadSize() ints, that started matching
+    // at start, along with every thread it continues to without consuming
+    // input.  Instructions already visited at this position are skipped;
+    // the thread that reached them first has higher priority.
+    void add(const int *thread, Offset start, Offset position);
+
+    // Advance the threads in priority order over the character c, which is
+    // -1 at the end of the input, adding the threads that consume it to
+    // next, at nextPosition.  Threads at MATCH instructions are passed to
+    // onMatch, which returns true to cut off all lower-priority threads.
+    template <typename OnMatch>
+    void step(int c, Offset nextPosition, NFAThreadList &next,
+              OnMatch onMatch);
+};
+
+
+template <typename Offset>
+template <typename OnMatch>
+void NFAThreadList<Offset>::step(int c, Offset nextPosition,
+                                 NFAThreadList &next, OnMatch onMatch) {
+    int numCounters = prog->numCounters();
+
+    for (const Thread &t : threads) {
+        const NFAInst &inst = (*prog)[t.pc];
+
+        if (inst.opcode == NFAInst::CONSUME) {
+            if (c != -1 &&
+                prog->getSet(inst.set).contains((unsigned char) c)) {
+                // The thread moves on with the same counter values.
+                int k = (int) (&t - threads.data());
+                auto from = counts.begin() + k * numCounters;
+                record[0] = t.pc + 1;
+                copy(from, from + numCounters, record.begin() + 1);
+                next.add(record.data(), t.start, nextPosition);
+            }
+        }
+        else if (inst.opcode == NFAInst::MATCH) {
+            if (onMatch(t))
+                break;
+        }
+    }
+}
+
+
+
+/* A Pike VM that simulates an NFAProgram over an input string, advancing all
+ * live threads in lock-step one character at a time.  Threads are kept in
+ * priority order, so the reported match is the same one the backtracking
+ * engine would find, but the running time is O(n * m) in the length of the
+ * input and the size of the program.  In a program with counters, threads at
+ * the same instruction with different counter values are different threads,
+ * so the size of the program is multiplied by the number of combinations of
+ * counter values that are live at once.
+ */
+class PikeVM {
+    const NFAProgram &prog;
+
+    // The thread that starts a match: instruction 0, with every counter
+    // at zero
+    vector<int> initial;
+
+    // The threads at the current and next input index, kept between
+    // searches so that they don't allocate
+    NFAThreadList<int> clist, nlist;
+
+    Range run(string_view s, int start, bool anchored, bool whole = false);
+
+public:
+    PikeVM(const NFAProgram &prog);
+
+    Range findAtIndex(string_view s, int start);
+    Range find(string_view s, int start = 0);
+    bool match(string_view s);
+};
+
+
+#endif // NFA_H
@@ -0,0 +1,277 @@
+#include "parallel.h"
+#include "stream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <thread>
+
+
+/* The parts of a buffer, each of which is searched through a window that
+ * extends far enough past its end to hold any match starting in it.
+ */
+class Partition {
+    string_view s;
+    size_t partSize, overlap;
+
+public:
+    Partition(string_view s, size_t partSize, size_t overlap) :
+        s(s), partSize(max<size_t>(partSize, 1)), overlap(overlap) {
+        // Nothing else to do.
+    }
+
+    size_t size() const {
+        return (s.length() + partSize - 1) / partSize;
+    }
+
+    int64_t begin(size_t k) const {
+        return (int64_t) (k * partSize);
+    }
+
+    // The number of indexes in the part where a match can start
+    int length(size_t k) const {
+        return (int) min(partSize, s.length() - k * partSize);
+    }
+
+    string_view window(size_t k) const {
+        return s.substr(k * partSize, partSize + overlap);
+    }
+};
+
+
+/* Call search(k, matcher) for parts 0, 1, 2, ... in order on a pool of
+ * threads, each with its own Matcher, until every part is done or search
+ * returns false; parts already started still finish.
+ */
+template <typename F>
+static void searchParts(const Regex &regex, size_t numParts, int numThreads,
+                        F search) {
+    atomic<size_t> next(0);
+    atomic<bool> stop(false);
+
+    auto worker = [&]() {
+        Matcher matcher(regex);
+        for (;;) {
+            size_t k = next++;
+            if (k >= numParts || stop)
+                return;
+            if (!search(k, matcher))
+                stop = true;
+        }
+    };
+
+    vector<thread> threads;
+    for (int t = 1; t < numThreads; t++)
+        threads.emplace_back(worker);
+    worker();
+    for (thread &t : threads)
+        t.join();
+}
+
+
+/* Returns the overlap the parts need, or -1 if they can't be searched
+ * separately, because a match can be any length, or because a window would
+ * be too long for the engines' int offsets.
+ */
+static int64_t partOverlap(const Regex &regex, size_t partSize) {
+    int maxLength = regex.getAnalysis().getMaxLength();
+    if (maxLength == -1 || partSize + maxLength > INT_MAX)
+        return -1;
+    return maxLength;
+}
+
+
+static LargeRange serialFind(const Regex &regex, string_view s) {
+    if (s.length() <= INT_MAX) {
+        Matcher matcher(regex);
+        Range r = matcher.find(s);
+        return LargeRange{r.start, r.end};
+    }
+
+    // Too long for the engines, so stream it, and stop at the first match.
+    LargeRange found{-1, -1};
+    StreamMatcher stream(regex, [&](const StreamMatch &m) {
+        if (found.start == -1)
+            found = LargeRange{m.start, m.end};
+    });
+    const size_t piece = 1 << 20;
+    for (size_t i = 0; i < s.length() && found.start == -1; i += piece)
+        stream.feed(s.substr(i, piece));
+    if (found.start == -1)
+        stream.finish();
+    return found;
+}
+
+
+static int64_t serialCount(const Regex &regex, string_view s) {
+    int64_t count = 0;
+    if (s.length() <= INT_MAX) {
+        Matcher matcher(regex);
+        for (const Range &r : matcher.findAll(s)) {
+            (void) r;
+            count++;
+        }
+        return count;
+    }
+
+    StreamMatcher stream(regex, [&](const StreamMatch &) { count++; });
+    stream.feed(s);
+    stream.finish();
+    return count;
+}
+
+
+LargeRange parallelFind(const Regex &regex, string_view s, int numThreads,
+                        size_t partSize) {
+    int64_t overlap = partOverlap(regex, partSize);
+    if (overlap == -1 || numThreads <= 1 || s.length() <= partSize)
+        return serialFind(regex, s);
+
+    Partition parts(s, partSize, overlap);
+    vector<Range> found(parts.size(), Range(-1, -1));
+    atomic<size_t> first(parts.size());
+
+    searchParts(regex, parts.size(), numThreads, [&](size_t k, Matcher &m) {
+        // A later part can't hold the first match if an earlier one does.
+        if (k > first)
+            return false;
+
+        Range r = m.find(parts.window(k));
+        if (r.start == -1 || r.start >= parts.length(k))
+            return true;
+
+        found[k] = r;
+        size_t current = first;
+        while (k < current && !first.compare_exchange_weak(current, k)) {
+            // Try again, unless another thread found an earlier part.
+        }
+        return false;
+    });
+
+    size_t k = first;
+    if (k == parts.size())
+        return LargeRange{-1, -1};
+    return LargeRange{parts.begin(k) + found[k].start,
+                      parts.begin(k) + found[k].end};
+}
+
+
+// The first few matches each part finds, which are enough to line up the
+// matches found again from the end of the part before
+static const size_t KEPT_MATCHES = 64;
+
+
+int64_t parallelCount(const Regex &regex, string_view s, int numThreads,
+                      size_t partSize) {
+    int64_t overlap = partOverlap(regex, partSize);
+    if (overlap == -1 || numThreads <= 1 || s.length() <= partSize)
+        return serialCount(regex, s);
+
+    // The matches starting in each part, if the search starts at the
+    // beginning of the part
+    struct PartMatches {
+        int64_t count = 0;
+        int lastEnd = 0;
+        vector<Range> first;
+    };
+
+    Partition parts(s, partSize, overlap);
+    vector<PartMatches> matches(parts.size());
+
+    searchParts(regex, parts.size(), numThreads, [&](size_t k, Matcher &m) {
+        PartMatches &pm = matches[k];
+        for (const Range &r : m.findAll(parts.window(k))) {
+            if (r.start >= parts.length(k))
+                break;
+            if (pm.first.size() < KEPT_MATCHES)
+                pm.first.push_back(r);
+            pm.count++;
+            pm.lastEnd = r.end;
+        }
+        return true;
+    });
+
+    // Stitch the parts together.  end is where the search for the next
+    // match starts, which is the end of the last match, or the start of
+    // the part if no match reaches past it.
+    Matcher matcher(regex);
+    int64_t count = 0, end = 0;
+
+    for (size_t k = 0; k < parts.size(); k++) {
+        const PartMatches &pm = matches[k];
+        int64_t begin = parts.begin(k);
+
+        if (end <= begin) {
+            count += pm.count;
+            if (pm.count > 0)
+                end = begin + pm.lastEnd;
+            continue;
+        }
+
+        // A match from an earlier part ends inside this one, so search
+        // from its end, until a match is one this part found too; from
+        // there on, the rest of the part's matches are the same.
+        string_view window = parts.window(k);
+        int from = (int) (end - begin);
+        while (from <= parts.length(k)) {
+            Range r = matcher.findFrom(window, from);
+            if (r.start == -1 || r.start >= parts.length(k))
+                break;
+
+            auto same = find_if(pm.first.begin(), pm.first.end(),
+                [&](const Range &p) {
+                    return p.start == r.start && p.end == r.end;
+                });
+            if (same != pm.first.end()) {
+                count += pm.count - (same - pm.first.begin());
+                end = begin + pm.lastEnd;
+                break;
+            }
+
+            count++;
+            end = begin + r.end;
+            from = r.end;
+        }
+    }
+    return count;
+}
+
+
+vector<uint64_t> batchMatch(const Regex &regex, const StringColumn &column,
+                            int numThreads) {
+    vector<uint64_t> bitmap((column.size + 63) / 64, 0);
+    size_t numBlocks = (column.size + BATCH_BLOCK_SIZE - 1) / BATCH_BLOCK_SIZE;
+
+    searchParts(regex, numBlocks, numThreads, [&](size_t b, Matcher &m) {
+        size_t end = min(column.size, (b + 1) * BATCH_BLOCK_SIZE);
+        for (size_t i = b * BATCH_BLOCK_SIZE; i < end; i++) {
+            if (m.match(column[i]))
+                bitmap[i / 64] |= (uint64_t) 1 << (i % 64);
+        }
+        return true;
+    });
+    return bitmap;
+}
+
+
+vector<uint64_t> batchFind(const Regex &regex, const StringColumn &column,
+                           int numThreads, vector<Range> *ranges) {
+    vector<uint64_t> bitmap((column.size + 63) / 64, 0);
+    size_t numBlocks = (column.size + BATCH_BLOCK_SIZE - 1) / BATCH_BLOCK_SIZE;
+    if (ranges != nullptr)
+        ranges->assign(column.size, Range(-1, -1));
+
+    searchParts(regex, numBlocks, numThreads, [&](size_t b, Matcher &m) {
+        size_t end = min(column.size, (b + 1) * BATCH_BLOCK_SIZE);
+        for (size_t i = b * BATCH_BLOCK_SIZE; i < end; i++) {
+            Range r = m.find(column[i]);
+            if (r.start == -1)
+                continue;
+            bitmap[i / 64] |= (uint64_t) 1 << (i % 64);
+            if (ranges != nullptr)
+                (*ranges)[i] = r;
+        }
+        return true;
+    });
+    return bitmap;
+}
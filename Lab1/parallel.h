@@ -0,0 +1,82 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "matcher.h"
+
+#include <cstdint>
+
+
+/* A match in a buffer that may be too large for the int offsets of a Range,
+ * or (-1, -1) if there is no match.
+ */
+struct LargeRange {
+    int64_t start, end;
+};
+
+
+// The size of the parts a buffer is split into for the worker threads
+const size_t DEFAULT_PART_SIZE = 16 << 20;
+
+
+/* Find the first non-empty match in the buffer, exactly as Matcher::find()
+ * would, by searching parts of it on several threads at once.
+ *
+ * Each part is searched along with the pattern's maximum match length of
+ * the text after it, which is all a match starting in the part can depend
+ * on, so each part's first match is exact, and the first part that has one
+ * holds the answer.  Parts are handed out in order, and none are started
+ * after one with a match.  A pattern whose match length is unbounded is
+ * searched on the calling thread alone.
+ */
+LargeRange parallelFind(const Regex &regex, string_view s, int numThreads,
+                        size_t partSize = DEFAULT_PART_SIZE);
+
+
+/* Count the matches findAll() would report in the buffer, by finding the
+ * matches in each part on several threads at once.  Each part's search
+ * starts at the beginning of the part; where a match from the part before
+ * runs past that point, the matches are found again from the end of that
+ * match until they line up with the ones the part found.  A pattern whose
+ * match length is unbounded is counted on the calling thread alone.
+ */
+int64_t parallelCount(const Regex &regex, string_view s, int numThreads,
+                      size_t partSize = DEFAULT_PART_SIZE);
+
+
+/* A column of strings stored back to back in one buffer, the way columnar
+ * formats store them: string i is data[offsets[i], offsets[i + 1]), so there
+ * are size + 1 offsets.  Each string must be shorter than 2 GB.
+ */
+struct StringColumn {
+    const char *data;
+    const int64_t *offsets;
+    size_t size;
+
+    string_view operator[](size_t i) const {
+        return string_view(data + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+};
+
+
+// The number of strings each worker thread takes at a time, which is a
+// multiple of 64 so that no two threads write the same word of a bitmap
+const size_t BATCH_BLOCK_SIZE = 4096;
+
+
+/* Match the regex against every entire string of the column, and return a
+ * bitmap with bit i % 64 of word i / 64 set if string i matches.  The
+ * strings are matched in blocks on several threads, which share the Regex
+ * and each reuse one Matcher for all of their strings.
+ */
+vector<uint64_t> batchMatch(const Regex &regex, const StringColumn &column,
+                            int numThreads);
+
+
+/* The same, with bit i set if string i contains a match.  If ranges is not
+ * null, it is filled with the first match in each string, or (-1, -1).
+ */
+vector<uint64_t> batchFind(const Regex &regex, const StringColumn &column,
+                           int numThreads, vector<Range> *ranges = nullptr);
+
+
+#endif // PARALLEL_H
@@ -0,0 +1,167 @@
+#include "prefilter.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PREFILTER_X86 1
+#include <immintrin.h>
+#endif
+
+
+LiteralPrefilter::LiteralPrefilter(const vector<RegexOperator *> &regex) :
+    minOffset(0), maxOffset(0) {
+
+    // Characters that can come before the current operator
+    int minBefore = 0, maxBefore = 0;
+
+    // The run of literal characters being built, and where it starts
+    string run;
+    int runMin = 0, runMax = 0;
+
+    for (size_t i = 0; i <= regex.size(); i++) {
+        const RegexOperator *op = i < regex.size() ? regex[i] : nullptr;
+        const MatchChar *mc = dynamic_cast<const MatchChar *>(op);
+        bool extendsRun = mc != nullptr && op->getMinRepeat() > 0;
+
+        if (extendsRun && run.empty()) {
+            runMin = minBefore;
+            runMax = maxBefore;
+        }
+        if (extendsRun)
+            run.append(op->getMinRepeat(), mc->getChar());
+
+        // The run ends at any operator that isn't a literal character, or
+        // after a literal character that can repeat a variable number of
+        // times.  Keep the longest run; ties go to the earliest.
+        if (!extendsRun || op->getMinRepeat() != op->getMaxRepeat()) {
+            if (run.length() > literal.length()) {
+                literal = run;
+                minOffset = runMin;
+                maxOffset = runMax;
+            }
+            run.clear();
+        }
+
+        if (op != nullptr) {
+            minBefore += op->getMinRepeat();
+            if (maxBefore != -1 && op->getMaxRepeat() != -1)
+                maxBefore += op->getMaxRepeat();
+            else
+                maxBefore = -1;
+        }
+    }
+}
+
+
+bool LiteralPrefilter::isActive() const {
+    return !literal.empty();
+}
+
+
+const string & LiteralPrefilter::getLiteral() const {
+    return literal;
+}
+
+
+int LiteralPrefilter::getMinOffset() const {
+    return minOffset;
+}
+
+
+int LiteralPrefilter::getMaxOffset() const {
+    return maxOffset;
+}
+
+
+int LiteralPrefilter::findLiteral(string_view s, int from) const {
+    if (from > (int) s.length())
+        return -1;
+
+    const char *begin = s.data();
+    const char *p = ::findLiteral(begin + from, begin + s.length(),
+                                  literal.data(), (int) literal.length());
+    return p == nullptr ? -1 : (int) (p - begin);
+}
+
+
+int LiteralPrefilter::nextCandidate(string_view s, int from,
+                                    int &literalPos) const {
+    if (!isActive())
+        return from;
+
+    // A match starting at from would contain the literal no earlier than
+    // from + minOffset.
+    if (literalPos < from + minOffset) {
+        literalPos = findLiteral(s, from + minOffset);
+        if (literalPos == -1)
+            return -1;
+    }
+
+    // And the literal would be no later than from + maxOffset.
+    if (maxOffset != -1)
+        return max(from, literalPos - maxOffset);
+    return from;
+}
+
+
+#ifdef PREFILTER_X86
+
+/* Find candidate positions where both the first and the last character of
+ * the needle appear at the right distance apart, 32 positions at a time, and
+ * only compare the rest of the needle at those positions.
+ */
+__attribute__((target("avx2")))
+static const char * findLiteralAVX2(const char *begin, const char *end,
+                                    const char *needle, int length) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[length - 1]);
+
+    const char *p = begin;
+    for (; end - p >= 32 + length - 1; p += 32) {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i *) p);
+        __m256i blockLast =
+            _mm256_loadu_si256((const __m256i *) (p + length - 1));
+
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(blockFirst, first),
+            _mm256_cmpeq_epi8(blockLast, last)));
+
+        while (mask != 0) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(p + bit + 1, needle + 1, length - 2) == 0)
+                return p + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return (const char *) memmem(p, end - p, needle, length);
+}
+
+#endif // PREFILTER_X86
+
+
+bool hasVectorLiteralSearch() {
+#ifdef PREFILTER_X86
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    return hasAVX2;
+#else
+    return false;
+#endif
+}
+
+
+const char * findLiteral(const char *begin, const char *end,
+                         const char *needle, int length) {
+    if (length == 0)
+        return begin;
+    if (length == 1)
+        return (const char *) memchr(begin, needle[0], end - begin);
+
+#ifdef PREFILTER_X86
+    if (hasVectorLiteralSearch())
+        return findLiteralAVX2(begin, end, needle, length);
+#endif
+
+    return (const char *) memmem(begin, end - begin, needle, length);
+}
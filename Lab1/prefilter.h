@@ -0,0 +1,60 @@
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include "regex.h"
+
+
+/* A literal string that every match of a regex must contain, along with the
+ * bounds on how far from the start of a match it can appear.  Searching for
+ * the literal is much faster than running a matching engine, so find() uses
+ * it to skip straight past indexes where no match can start.
+ *
+ * The literal is the longest run of consecutive operators that each match
+ * one specific character a fixed number of times; when the run is at the
+ * start of the regex, it is a required prefix and both offsets are 0.
+ */
+class LiteralPrefilter {
+    string literal;
+
+    // The smallest and largest number of characters that can come before
+    // the literal in a match.  The maximum is -1 if it is unbounded.
+    int minOffset, maxOffset;
+
+public:
+    LiteralPrefilter(const vector<RegexOperator *> &regex);
+
+    // Returns false if the regex contains no required literal.
+    bool isActive() const;
+
+    const string & getLiteral() const;
+    int getMinOffset() const;
+    int getMaxOffset() const;
+
+    // Returns the index of the first occurrence of the literal at or after
+    // index from, or -1 if there isn't one.
+    int findLiteral(string_view s, int from) const;
+
+    // Returns the first index at or after from where a match could start,
+    // or -1 if no match can start there.  literalPos caches the last
+    // occurrence of the literal found; it should start at -1, and be passed
+    // back unchanged as the search advances through the same string.
+    int nextCandidate(string_view s, int from, int &literalPos) const;
+};
+
+
+/* Reports whether findLiteral() can use vector instructions on this
+ * processor.
+ */
+bool hasVectorLiteralSearch();
+
+
+/* Returns a pointer to the first occurrence of the needle in the range
+ * [begin, end), or nullptr if there isn't one.  Compares the first and last
+ * characters of the needle against 32 positions at a time with AVX2 when the
+ * processor supports it.
+ */
+const char * findLiteral(const char *begin, const char *end,
+                         const char *needle, int length);
+
+
+#endif // PREFILTER_H
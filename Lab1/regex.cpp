@@ -1,5 +1,7 @@
 #include "regex.h"
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
 
 /* Initialize the regex operator to apply exactly once. */
 RegexOperator::RegexOperator() {
@@ -34,38 +36,7 @@ void RegexOperator::setMaxRepeat(int n) {
 }
 
 
-/* Clears the list of matches stored in the regex operator.  Typically done
- * in preparation to try to match the regex to a new string.
- */
-void RegexOperator::clearMatches() {
-    matches.clear();
-}
-
-
-/* Records a new match of the operator in the list of matches. */
-void RegexOperator::pushMatch(const Range &r) {
-    matches.push_back(r);
-}
-
-
-/* Reports how many times the regex operator has successfully matched in the
- * string.
- */
-int RegexOperator::numMatches() const {
-    return (int) matches.size();
-}
-
-
-/* Removes the last match the operator successfully matched against.  Used for
- * backtracking by the regex engine.
- */
-Range RegexOperator::popMatch() {
-    Range r = matches.back();
-    matches.pop_back();
-    return r;
-}
-
-void clearRegex(vector<RegexOperator *> regex) {
+void clearRegex(const vector<RegexOperator *> &regex) {
     for (auto* op : regex) {
         delete op;
     }
@@ -74,8 +45,11 @@ void clearRegex(vector<RegexOperator *> regex) {
 MatchChar::MatchChar(const char  &match_char) {
     this->match_char = match_char;
 }
-bool MatchChar::match(const string &s, Range &r) const {
-    if (r.start >= s.length()) {
+char MatchChar::getChar() const {
+    return match_char;
+}
+bool MatchChar::match(string_view s, Range &r) const {
+    if (r.start >= (int) s.length()) {
         return false;
     }
     if (s[r.start] == match_char) {
@@ -84,45 +58,84 @@ bool MatchChar::match(const string &s, Range &r) const {
     }
     return false;
 }
+int MatchChar::matchRun(string_view s, int pos, int limit) const {
+    int n = 0;
+    while (n < limit && s[pos + n] == match_char)
+        n++;
+    return n;
+}
+CharSet MatchChar::getMatchingChars() const {
+    CharSet set;
+    set.add((unsigned char) match_char);
+    return set;
+}
 
 MatchAny::MatchAny(){};
 
-bool MatchAny::match(const string &s, Range &r) const {
-    if (r.start < s.length()) {
+bool MatchAny::match(string_view s, Range &r) const {
+    if (r.start < (int) s.length()) {
         r.end = r.start + 1;
         return true;
     }
     return false;
 }
 
-MatchFromSubset::MatchFromSubset(const string &match_str) : match_str(match_str) {}
+int MatchAny::matchRun(string_view, int, int limit) const {
+    return limit;
+}
+
+CharSet MatchAny::getMatchingChars() const {
+    CharSet set;
+    set.addAll();
+    return set;
+}
+
+MatchFromSubset::MatchFromSubset(const string &match_str) {
+    match_set.add(match_str.data(), (int) match_str.length());
+}
 
-bool MatchFromSubset::match(const string &s, Range &r) const {
-     if (r.start >= s.length()) {
+bool MatchFromSubset::match(string_view s, Range &r) const {
+     if (r.start >= (int) s.length()) {
         return false;
     } 
-    char c = s[r.start];
-    for (const auto match_char : match_str) {
-        if (match_char == c) {
-            r.end = r.start + 1;
-            return true;
-        }
+    if (match_set.contains((unsigned char) s[r.start])) {
+        r.end = r.start + 1;
+        return true;
     }
     return false;
 }
-ExcludeFromSubset::ExcludeFromSubset(const string &exclude_str) : exclude_str(exclude_str) {}
-bool ExcludeFromSubset::match(const string &s, Range &r) const {
-     if (r.start >= s.length()) {
+
+int MatchFromSubset::matchRun(string_view s, int pos, int limit) const {
+    const char *begin = s.data() + pos;
+    return (int) (findFirstNonMember(match_set, begin, begin + limit) - begin);
+}
+
+CharSet MatchFromSubset::getMatchingChars() const {
+    return match_set;
+}
+ExcludeFromSubset::ExcludeFromSubset(const string &exclude_str) {
+    CharSet exclude_set;
+    exclude_set.add(exclude_str.data(), (int) exclude_str.length());
+    match_set = exclude_set.complement();
+}
+bool ExcludeFromSubset::match(string_view s, Range &r) const {
+     if (r.start >= (int) s.length()) {
         return false;
     } 
-    char c = s[r.start];
-    for (const auto exclude_char : exclude_str) {
-        if (exclude_char  == c) {
-            return false;
-        }
+    if (match_set.contains((unsigned char) s[r.start])) {
+        r.end = r.start + 1;
+        return true;
     }
-    r.end = r.start + 1;
-    return true;
+    return false;
+}
+
+int ExcludeFromSubset::matchRun(string_view s, int pos, int limit) const {
+    const char *begin = s.data() + pos;
+    return (int) (findFirstNonMember(match_set, begin, begin + limit) - begin);
+}
+
+CharSet ExcludeFromSubset::getMatchingChars() const {
+    return match_set;
 }
 
 pair<int, int>  getMinMaxRepeats(const char c) {
@@ -137,44 +150,175 @@ pair<int, int>  getMinMaxRepeats(const char c) {
            return make_pair(1, 1);
     }
 }
-vector<RegexOperator *> parseRegex(const string &expr) {
-    vector<RegexOperator *> operators{};
-    for (int i = 0; i < expr.length(); i++) {
+/* Parse the decimal number at expr[j], advancing j past it.  Returns -1 if
+ * there are no digits there.  Numbers too large for a repeat count are
+ * reported as MAX_REPEAT_COUNT + 1, rather than overflowing.
+ */
+static int parseCount(const string &expr, int &j) {
+    int n = -1;
+    while (j < (int) expr.length() && expr[j] >= '0' && expr[j] <= '9') {
+        n = max(n, 0) * 10 + (expr[j] - '0');
+        n = min(n, MAX_REPEAT_COUNT + 1);
+        j++;
+    }
+    return n;
+}
+
+int parseRepeat(const string &expr, int i, int &minRepeat, int &maxRepeat) {
+    minRepeat = 1;
+    maxRepeat = 1;
+
+    int length = (int) expr.length();
+    if (i + 1 >= length)
+        return i;
+
+    if (expr[i + 1] != '{') {
+        auto res = getMinMaxRepeats(expr[i + 1]);
+        minRepeat = res.first;
+        maxRepeat = res.second;
+        return (res.first == 1 && res.second == 1) ? i : i + 1;
+    }
+
+    int j = i + 2;
+    int low = parseCount(expr, j), high = low;
+    if (low == -1)
+        return i;
+    if (j < length && expr[j] == ',') {
+        j++;
+        high = parseCount(expr, j);
+    }
+    if (j >= length || expr[j] != '}')
+        return i;
+
+    if (low > MAX_REPEAT_COUNT || high > MAX_REPEAT_COUNT)
+        throw invalid_argument("repeat count is too large");
+    if (high != -1 && high < low)
+        throw invalid_argument("repeat count maximum is less than minimum");
+
+    minRepeat = low;
+    maxRepeat = high;
+    return j;
+}
+
+int classEnd(const string &expr, int i) {
+    size_t end = expr.find(']', i + 1);
+    if (end == string::npos)
+        throw invalid_argument("unterminated character class");
+    return (int) end;
+}
+
+int escapedChar(const string &expr, int i) {
+    if (i + 1 == (int) expr.length())
+        throw invalid_argument("pattern ends with an escape");
+    return i + 1;
+}
+
+/* Create an operator in the arena, or on the heap if there is no arena. */
+template <typename T, typename Arg>
+static RegexOperator * makeOperator(RegexArena *arena, const Arg &arg) {
+    if (arena != nullptr)
+        return arena->create<T>(arg);
+    return new T(arg);
+}
+
+template <typename T>
+static RegexOperator * makeOperator(RegexArena *arena) {
+    if (arena != nullptr)
+        return arena->create<T>();
+    return new T();
+}
+
+static void parseRegex(const string &expr, RegexArena *arena,
+                       vector<RegexOperator *> &operators) {
+    for (int i = 0; i < (int) expr.length(); i++) {
         const char& c = expr[i];
         RegexOperator* op;
-        if (c == '.') {
-            op = new MatchAny();
+        if (c == '(' || c == ')' || c == '|') {
+            throw invalid_argument(
+                "groups and alternation can't be parsed into operators");
+        }
+        else if (c == '.') {
+            op = makeOperator<MatchAny>(arena);
         }
         else if (c == '\\') {
-            i++; // TODO: Check in range
-            op = new MatchChar(expr[i]);
+            i = escapedChar(expr, i);
+            op = makeOperator<MatchChar>(arena, expr[i]);
         }
         else if (c=='[') {
+            int end = classEnd(expr, i);
             bool exclude = expr[i+1] == '^' ? true : false;
             int first = exclude ? i+2 : i+1; 
-            while (expr[i] != ']') {
-                i++;
-            }
+            i = end;
             if (!exclude) {
-                op = new MatchFromSubset(expr.substr(first, i-first));
+                op = makeOperator<MatchFromSubset>(
+                    arena, expr.substr(first, i-first));
             }
             else {
-                op = new ExcludeFromSubset(expr.substr(first, i-first));
+                op = makeOperator<ExcludeFromSubset>(
+                    arena, expr.substr(first, i-first));
             }
         }
         else {
-            op = new MatchChar(expr[i]);
+            op = makeOperator<MatchChar>(arena, expr[i]);
         }
 
-        if (i < expr.length()-1) {
-            auto res = getMinMaxRepeats(expr[i+1]);
-            op->setMinRepeat(res.first);
-            op->setMaxRepeat(res.second);
-            if (!(res.first == 1 && res.second == 1)) {
-                i++;
-            }
-        }
+        // Keep the operator before parsing its repeat, which may throw, so
+        // that it is freed with the rest.
         operators.emplace_back(op);
+
+        int minRepeat, maxRepeat;
+        i = parseRepeat(expr, i, minRepeat, maxRepeat);
+        op->setMinRepeat(minRepeat);
+        op->setMaxRepeat(maxRepeat);
     }
+}
+
+vector<RegexOperator *> parseRegex(const string &expr) {
+    vector<RegexOperator *> operators{};
+    try {
+        parseRegex(expr, nullptr, operators);
+    } catch (...) {
+        clearRegex(operators);
+        throw;
+    }
+    return operators;
+}
+
+/* Work out how much arena space the operators of the regex need, by
+ * scanning it the same way parseRegex() does.
+ */
+static size_t arenaSizeFor(const string &expr, int &numOperators) {
+    size_t size = 0;
+    numOperators = 0;
+    for (int i = 0; i < (int) expr.length(); i++) {
+        if (expr[i] == '.') {
+            size += arenaSize<MatchAny>();
+        }
+        else if (expr[i] == '[') {
+            i = classEnd(expr, i);
+            size += max(arenaSize<MatchFromSubset>(),
+                        arenaSize<ExcludeFromSubset>());
+        }
+        else {
+            if (expr[i] == '\\')
+                i = escapedChar(expr, i);
+            size += arenaSize<MatchChar>();
+        }
+
+        int minRepeat, maxRepeat;
+        i = parseRepeat(expr, i, minRepeat, maxRepeat);
+        numOperators++;
+    }
+    return size;
+}
+
+vector<RegexOperator *> parseRegex(const string &expr, RegexArena &arena) {
+    int numOperators;
+    arena.reset(arenaSizeFor(expr, numOperators));
+
+    vector<RegexOperator *> operators{};
+    operators.reserve(numOperators);
+    parseRegex(expr, &arena, operators);
+    assert((int) operators.size() == numOperators);
     return operators;
 }
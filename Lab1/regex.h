@@ -1,5 +1,12 @@
+#ifndef REGEX_H
+#define REGEX_H
+
+#include "arena.h"
+#include "charclass.h"
+
 #include <cassert>
 #include <string>
+#include <string_view>
 #include <vector>
 
 using namespace std;
@@ -53,9 +60,6 @@ class RegexOperator {
     // at least -1; -1 indicates "unlimited matches", and all other values
     // specify an actual maximum number of matches.
     int minRepeat, maxRepeat;
-    
-    // A vector of ranges where the regex operator has matched the test string.
-    vector<Range> matches;
 public:
     RegexOperator();
 
@@ -65,24 +69,63 @@ public:
     void setMinRepeat(int n);
     void setMaxRepeat(int n);
 
-    // Operations to support backtracking
-    void clearMatches();
-    void pushMatch(const Range &r);
-    int numMatches() const;
-    Range popMatch();
-    virtual bool match(const string &s, Range &r) const = 0;
+    // Operators are immutable once parsed; the state the backtracking engine
+    // needs while matching lives in a BacktrackContext (see engine.h), so one
+    // parsed regex can be used by many threads at once.
+    virtual bool match(string_view s, Range &r) const = 0;
+
+    // Every operator consumes exactly one character per application, so a
+    // run of repetitions is just a count.  Returns how many characters in a
+    // row, starting at s[pos] and up to limit of them, the operator matches.
+    virtual int matchRun(string_view s, int pos, int limit) const = 0;
+
+    // The set of characters a single application of the operator accepts
+    virtual CharSet getMatchingChars() const = 0;
     virtual ~RegexOperator() = default;
 };
 
 
+// The largest count a repeat in braces may have
+static constexpr int MAX_REPEAT_COUNT = 1000;
+
+// Parse the repeat that follows the atom ending at expr[i], if there is one:
+// ?, *, + or a count in braces, {m}, {m,} or {m,n}.  Sets the repeat counts,
+// and returns the index of the last character of the repeat, or i if there
+// isn't one.  A brace that doesn't start a well-formed count is an ordinary
+// character.  Throws invalid_argument if a count is larger than
+// MAX_REPEAT_COUNT, or the maximum is less than the minimum.
+int parseRepeat(const string &expr, int i, int &minRepeat, int &maxRepeat);
+
+// Returns the index of the ] that closes the character class starting at
+// expr[i], which is the first ] after the [.  Throws invalid_argument if
+// there isn't one.
+int classEnd(const string &expr, int i);
+
+// Returns the index of the character escaped by the \ at expr[i].  Throws
+// invalid_argument if the pattern ends with the \.
+int escapedChar(const string &expr, int i);
+
+// Parse a pattern that is a sequence of atoms, each with an optional repeat.
+// Throws invalid_argument if a character class is unterminated, or the
+// pattern ends with a \.  Also throws if the pattern has groups or
+// alternation, which can't be written as operators; compile such patterns
+// with a Regex.
 vector<RegexOperator *> parseRegex(const string &expr);
-void clearRegex(vector<RegexOperator *> regex);
+void clearRegex(const vector<RegexOperator *> &regex);
+
+// Parse the regex with every operator in one block owned by the arena, so
+// that the operators are freed all at once with the arena, and must not be
+// passed to clearRegex().
+vector<RegexOperator *> parseRegex(const string &expr, RegexArena &arena);
 
 class MatchChar : public RegexOperator {
     char match_char;
 public:
     MatchChar(const char& match_char);
-    bool match(const string &s, Range &r) const;
+    char getChar() const;
+    bool match(string_view s, Range &r) const;
+    int matchRun(string_view s, int pos, int limit) const;
+    CharSet getMatchingChars() const;
     ~MatchChar() = default;
 };
 
@@ -90,24 +133,36 @@ class MatchAny : public RegexOperator {
     
 public:
     MatchAny();
-    bool match(const string &s, Range &r) const;
+    bool match(string_view s, Range &r) const;
+    int matchRun(string_view s, int pos, int limit) const;
+    CharSet getMatchingChars() const;
     ~MatchAny(){};
 };
 
 
+// Character classes are stored as bitmaps, so that matching a character costs
+// the same no matter how many characters the class lists.
 class MatchFromSubset : public RegexOperator {
-    string match_str; 
+    CharSet match_set;
 public:
     MatchFromSubset(const string& match_str);
-    bool match(const string &s, Range &r) const;
+    bool match(string_view s, Range &r) const;
+    int matchRun(string_view s, int pos, int limit) const;
+    CharSet getMatchingChars() const;
     ~MatchFromSubset(){};
 };
 
 
+// The bitmap holds the characters that are *not* excluded.
 class ExcludeFromSubset : public RegexOperator {
-    string exclude_str; 
+    CharSet match_set;
 public:
     ExcludeFromSubset(const string& exclude_str);
-    bool match(const string &s, Range &r) const;
+    bool match(string_view s, Range &r) const;
+    int matchRun(string_view s, int pos, int limit) const;
+    CharSet getMatchingChars() const;
     ~ExcludeFromSubset(){};
 };
+
+
+#endif // REGEX_H
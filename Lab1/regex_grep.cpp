@@ -0,0 +1,144 @@
+#include "grep.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+static void usage() {
+    cerr << "usage: regex_grep [-c] [-s] [-j threads] [-b chunk-kb] pattern "
+            "file..." << endl
+         << "  -c  print only the number of matching lines" << endl
+         << "  -s  report the throughput on stderr" << endl
+         << "  -j  the number of worker threads (default: every core)" << endl
+         << "  -b  the size of the chunks the workers search (default: 4096)"
+         << endl;
+}
+
+
+/* A file mapped into memory, read-only, for as long as the object lives. */
+class MappedFile {
+    const char *data;
+    size_t length;
+
+public:
+    MappedFile(const char *path) : data(nullptr), length(0) {
+        int fd = open(path, O_RDONLY);
+        if (fd == -1)
+            return;
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void *p = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd,
+                           0);
+            if (p != MAP_FAILED) {
+                madvise(p, info.st_size, MADV_SEQUENTIAL);
+                data = (const char *) p;
+                length = info.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (data != nullptr)
+            munmap((void *) data, length);
+    }
+
+    MappedFile(const MappedFile &other) = delete;
+    MappedFile & operator=(const MappedFile &other) = delete;
+
+    string_view contents() const {
+        return string_view(data, length);
+    }
+};
+
+
+int main(int argc, char **argv) {
+    GrepOptions options;
+    options.numThreads = max(1u, thread::hardware_concurrency());
+    bool reportStats = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "csj:b:")) != -1) {
+        switch (opt) {
+        case 'c':
+            options.countOnly = true;
+            break;
+        case 's':
+            reportStats = true;
+            break;
+        case 'j':
+            options.numThreads = atoi(optarg);
+            break;
+        case 'b':
+            options.chunkSize = (size_t) atol(optarg) << 10;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+    if (argc - optind < 2 || options.numThreads < 1 ||
+        options.chunkSize == 0) {
+        usage();
+        return 2;
+    }
+
+    const Regex regex(argv[optind]);
+    bool manyFiles = argc - optind > 2;
+    long totalLines = 0;
+    size_t totalBytes = 0;
+    int status = 1;
+
+    auto start = chrono::steady_clock::now();
+
+    for (int i = optind + 1; i < argc; i++) {
+        const char *path = argv[i];
+        if (access(path, R_OK) != 0) {
+            perror(path);
+            status = 2;
+            continue;
+        }
+
+        // Prefix each line with the file name, like grep, when there is
+        // more than one file.
+        MappedFile file(path);
+        options.prefix = manyFiles ? string(path) + ":" : "";
+
+        long lines = parallelGrep(regex, file.contents(), options,
+            [](const string &output) {
+                fwrite(output.data(), 1, output.length(), stdout);
+            });
+        if (options.countOnly)
+            cout << options.prefix << lines << endl;
+
+        totalLines += lines;
+        totalBytes += file.contents().length();
+        if (lines > 0 && status == 1)
+            status = 0;
+    }
+    fflush(stdout);
+
+    if (reportStats) {
+        double seconds = chrono::duration<double>(
+            chrono::steady_clock::now() - start).count();
+        cerr << totalLines << " matching lines in " << totalBytes
+             << " bytes, " << fixed << setprecision(3) << seconds << " s, "
+             << totalBytes / seconds / 1e9 << " GB/s on "
+             << options.numThreads << " threads" << endl;
+    }
+    return status;
+}
@@ -0,0 +1,129 @@
+#include "regexset.h"
+
+#include <algorithm>
+
+
+/* Returns the program of each regex, for combining into one program. */
+vector<const NFAProgram *> RegexSet::programsOf(
+    const vector<unique_ptr<Regex>> &regexes) {
+
+    vector<const NFAProgram *> programs;
+    for (const unique_ptr<Regex> &regex : regexes)
+        programs.push_back(&regex->getProgram());
+    return programs;
+}
+
+
+static vector<unique_ptr<Regex>> compileEach(const vector<string> &patterns) {
+    vector<unique_ptr<Regex>> regexes;
+    for (const string &pattern : patterns)
+        regexes.push_back(make_unique<Regex>(pattern));
+    return regexes;
+}
+
+
+static vector<unique_ptr<Regex>> compileEach(
+    const vector<vector<RegexOperator *>> &operators) {
+
+    vector<unique_ptr<Regex>> regexes;
+    for (const vector<RegexOperator *> &ops : operators)
+        regexes.push_back(make_unique<Regex>(ops));
+    return regexes;
+}
+
+
+RegexSet::RegexSet(const vector<string> &patterns) :
+    regexes(compileEach(patterns)), program(programsOf(regexes)) {
+    // Nothing else to do.
+}
+
+
+RegexSet::RegexSet(const vector<vector<RegexOperator *>> &operators) :
+    regexes(compileEach(operators)), program(programsOf(regexes)) {
+    // Nothing else to do.
+}
+
+
+int RegexSet::size() const {
+    return (int) regexes.size();
+}
+
+
+const Regex & RegexSet::getRegex(int k) const {
+    assert(k >= 0 && k < (int) regexes.size());
+    return *regexes[k];
+}
+
+
+const NFAProgram & RegexSet::getProgram() const {
+    return program;
+}
+
+
+SetMatcher::SetMatcher(const RegexSet &set, size_t dfaMemoryBudget) :
+    set(set), dfaMemoryBudget(dfaMemoryBudget), fallback(set.size()) {
+    // Nothing else to do.
+}
+
+
+Matcher & SetMatcher::getFallback(int k) {
+    if (!fallback[k])
+        fallback[k] = make_unique<Matcher>(set.getRegex(k));
+    return *fallback[k];
+}
+
+
+vector<int> SetMatcher::match(string_view s) {
+    if (set.size() == 0)
+        return vector<int>();
+
+    if (!anchored) {
+        anchored = make_unique<LazyDFA>(set.getProgram(), LazyDFA::LONGEST,
+                                        true, dfaMemoryBudget);
+    }
+
+    vector<int> found;
+    if (anchored->searchSet(s, found)) {
+        sort(found.begin(), found.end());
+        return found;
+    }
+
+    for (int k = 0; k < set.size(); k++) {
+        if (getFallback(k).match(s))
+            found.push_back(k);
+    }
+    return found;
+}
+
+
+vector<int> SetMatcher::search(string_view s) {
+    if (set.size() == 0)
+        return vector<int>();
+
+    if (!unanchored) {
+        unanchored = make_unique<LazyDFA>(set.getProgram(), LazyDFA::LONGEST,
+                                          false, dfaMemoryBudget);
+    }
+
+    vector<int> found;
+    if (unanchored->searchSet(s, found)) {
+        sort(found.begin(), found.end());
+        return found;
+    }
+
+    for (int k = 0; k < set.size(); k++) {
+        if (getFallback(k).find(s).start != -1)
+            found.push_back(k);
+    }
+    return found;
+}
+
+
+DFAStats SetMatcher::getDFAStats() const {
+    DFAStats total;
+    if (anchored)
+        total += anchored->getStats();
+    if (unanchored)
+        total += unanchored->getStats();
+    return total;
+}
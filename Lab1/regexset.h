@@ -0,0 +1,79 @@
+#ifndef REGEXSET_H
+#define REGEXSET_H
+
+#include "matcher.h"
+
+
+/* A set of regexes compiled into one program, so that a single pass over a
+ * string finds every regex in the set that matches it.  Like a Regex, a
+ * RegexSet is immutable once it is constructed, and can be shared by any
+ * number of threads, as long as each one matches through its own
+ * SetMatcher.
+ */
+class RegexSet {
+    // Each regex on its own, for the fallback engine
+    vector<unique_ptr<Regex>> regexes;
+
+    NFAProgram program;
+
+    static vector<const NFAProgram *> programsOf(
+        const vector<unique_ptr<Regex>> &regexes);
+
+public:
+    // Parse and compile the patterns.
+    RegexSet(const vector<string> &patterns);
+
+    // Compile operators produced by parseRegex(), which are not copied or
+    // owned by the set, and must outlive it.
+    RegexSet(const vector<vector<RegexOperator *>> &operators);
+
+    RegexSet(const RegexSet &other) = delete;
+    RegexSet & operator=(const RegexSet &other) = delete;
+
+    int size() const;
+    const Regex & getRegex(int k) const;
+
+    // The program for the whole set; each MATCH instruction holds the index
+    // of its regex
+    const NFAProgram & getProgram() const;
+};
+
+
+/* The scratch state needed to match a RegexSet against strings.
+ *
+ * Both searches run a lazy DFA over the combined program that keeps the
+ * threads of every regex, so once its cache is warm each character costs one
+ * table lookup, however many regexes there are.  The DFA's states are sets of
+ * instructions from many regexes, so they are larger than a single regex's,
+ * and the memory budget is larger to match.  If the DFA gives up, each regex
+ * is tried on its own.
+ */
+class SetMatcher {
+    const RegexSet &set;
+    size_t dfaMemoryBudget;
+
+    // Built on first use
+    unique_ptr<LazyDFA> anchored, unanchored;
+    vector<unique_ptr<Matcher>> fallback;
+
+    Matcher & getFallback(int k);
+
+public:
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = 16 << 20;
+
+    SetMatcher(const RegexSet &set,
+               size_t dfaMemoryBudget = DEFAULT_MEMORY_BUDGET);
+
+    // The indexes of the regexes that match the entire string, in order
+    vector<int> match(string_view s);
+
+    // The indexes of the regexes with a non-empty match anywhere in the
+    // string, in order
+    vector<int> search(string_view s);
+
+    // Counters from the DFAs, if they have been used
+    DFAStats getDFAStats() const;
+};
+
+
+#endif // REGEXSET_H
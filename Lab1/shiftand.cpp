@@ -0,0 +1,185 @@
+#include "shiftand.h"
+
+#include <cstring>
+
+
+/* Reports whether the operator's repeat count is one the automaton can
+ * represent with a single state.
+ */
+static bool hasSimpleRepeat(const RegexOperator *op) {
+    int min = op->getMinRepeat(), max = op->getMaxRepeat();
+    return (min == 0 || min == 1) && (max == 1 || max == -1);
+}
+
+
+bool ShiftAndSearcher::canSearch(const vector<RegexOperator *> &regex) {
+    if (regex.empty() || regex.size() > MAX_OPERATORS)
+        return false;
+    for (const RegexOperator *op : regex) {
+        if (!hasSimpleRepeat(op))
+            return false;
+    }
+    return true;
+}
+
+
+ShiftAndSearcher::ShiftAndSearcher(const vector<RegexOperator *> &regex) :
+    active(canSearch(regex)), matchesEmpty(true) {
+
+    for (const RegexOperator *op : regex) {
+        if (op->getMinRepeat() > 0)
+            matchesEmpty = false;
+    }
+
+    memset(&forward, 0, sizeof(forward));
+    memset(&reverse, 0, sizeof(reverse));
+    if (active) {
+        compile(forward, regex, false);
+        compile(reverse, regex, true);
+    }
+}
+
+
+/* Fill in the masks for the operators, in reverse order if reversed is
+ * true.
+ */
+void ShiftAndSearcher::compile(Automaton &automaton,
+                               const vector<RegexOperator *> &regex,
+                               bool reversed) {
+    int n = (int) regex.size();
+    for (int i = 0; i < n; i++) {
+        const RegexOperator *op = regex[reversed ? n - 1 - i : i];
+        uint64_t bit = (uint64_t) 1 << i;
+
+        op->getMatchingChars().forEach([&](unsigned char c) {
+            automaton.accepts[c] |= bit;
+        });
+
+        if (op->getMaxRepeat() != 1)
+            automaton.repeatable |= bit;
+        if (op->getMinRepeat() == 0)
+            automaton.optional |= bit;
+    }
+
+    // Working back from the last operator, each state is final until an
+    // operator that can't be skipped.
+    for (int i = n - 1; i >= 0; i--) {
+        automaton.final |= (uint64_t) 1 << i;
+        if ((automaton.optional >> i & 1) == 0)
+            break;
+    }
+}
+
+
+/* Returns the states after consuming c.  entry is 1 to also start a match
+ * before c, and 0 otherwise.
+ */
+static inline uint64_t step(const uint64_t accepts[256], uint64_t repeatable,
+                            uint64_t optional, uint64_t states,
+                            uint64_t entry, unsigned char c) {
+    // Every operator the states can move on to next.  Adding a state that
+    // sits on an optional operator to the mask of optional operators
+    // carries it to the end of their run, and the bits it flips are the
+    // operators it passes through, plus the one after the run.
+    uint64_t next = (states << 1) | entry;
+    next |= (optional + (next & optional)) ^ optional;
+
+    return (next | (states & repeatable)) & accepts[c];
+}
+
+
+bool ShiftAndSearcher::isActive() const {
+    return active;
+}
+
+
+/* Returns where the longest match starting at the index ends, or -1 if no
+ * match starts there.
+ */
+int ShiftAndSearcher::longestEnd(string_view s, int start) const {
+    const Automaton &a = forward;
+    int end = matchesEmpty ? start : -1;
+
+    uint64_t states = 0, entry = 1;
+    for (int i = start; i < (int) s.length(); i++) {
+        states = step(a.accepts, a.repeatable, a.optional, states, entry,
+                      (unsigned char) s[i]);
+        if (states == 0)
+            break;
+        if (states & a.final)
+            end = i + 1;
+        entry = 0;
+    }
+    return end;
+}
+
+
+/* Find the match starting at the specified index, which is the longest one
+ * there, and may be empty.  If there is no match at the index, the range
+ * (-1, -1) is returned.
+ */
+Range ShiftAndSearcher::findAtIndex(string_view s, int start) const {
+    int end = longestEnd(s, start);
+    if (end == -1)
+        return Range(-1, -1);
+    return Range(start, end);
+}
+
+
+/* Find the first non-empty match that starts at or after the specified
+ * index.  If there is no match, the range (-1, -1) is returned.
+ */
+Range ShiftAndSearcher::find(string_view s, int start) const {
+    const Automaton &f = forward;
+    const Automaton &r = reverse;
+    const char *data = s.data();
+    int length = (int) s.length();
+
+    // Where the first non-empty match ends
+    int end = -1;
+    uint64_t states = 0;
+    for (int i = start; i < length; i++) {
+        states = step(f.accepts, f.repeatable, f.optional, states, 1,
+                      (unsigned char) data[i]);
+        if (states & f.final) {
+            end = i + 1;
+            break;
+        }
+    }
+    if (end == -1)
+        return Range(-1, -1);
+
+    // The leftmost index where a match ending there starts
+    int matchStart = end - 1;
+    states = 0;
+    uint64_t entry = 1;
+    for (int i = end - 1; i >= start; i--) {
+        states = step(r.accepts, r.repeatable, r.optional, states, entry,
+                      (unsigned char) data[i]);
+        if (states == 0)
+            break;
+        if (states & r.final)
+            matchStart = i;
+        entry = 0;
+    }
+
+    return Range(matchStart, longestEnd(s, matchStart));
+}
+
+
+/* Reports whether the regex matches the entire string. */
+bool ShiftAndSearcher::match(string_view s) const {
+    if (s.empty())
+        return false;
+
+    const Automaton &a = forward;
+    uint64_t states = 0, entry = 1;
+    for (char c : s) {
+        states = step(a.accepts, a.repeatable, a.optional, states, entry,
+                      (unsigned char) c);
+        if (states == 0)
+            return false;
+        entry = 0;
+    }
+    return (states & a.final) != 0;
+}
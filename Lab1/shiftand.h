@@ -0,0 +1,77 @@
+#ifndef SHIFTAND_H
+#define SHIFTAND_H
+
+#include "regex.h"
+
+#include <cstdint>
+
+
+/* An engine that simulates the regex's Glushkov automaton with bit-parallel
+ * Shift-And, for regexes of at most 64 operators.  Every operator consumes
+ * one character per repetition, so the automaton has one state per operator,
+ * meaning "the last character was consumed by this operator", and the set
+ * of live states fits in one 64-bit word.  A character then costs a handful
+ * of word operations, with no table of states to build or to miss in:
+ *
+ *   - shifting the word left by one moves every state on to the next
+ *     operator;
+ *   - adding the word to the mask of optional operators carries each state
+ *     through any run of them, to every operator it can skip to;
+ *   - states of repeated operators may also stay where they are;
+ *   - ANDing with the mask of operators that accept the character keeps
+ *     only the states that can consume it.
+ *
+ * Because every operator matches one character at a time, the match the
+ * backtracking engine prefers at an index is always the longest one there,
+ * and the leftmost index with a non-empty match always has one ending where
+ * the first match of all ends.  So find() scans forward to where the first
+ * match ends, backward over the reversed regex to the leftmost index where a
+ * match ending there starts, and forward again to the end of the longest
+ * match from that index.
+ */
+class ShiftAndSearcher {
+public:
+    static constexpr int MAX_OPERATORS = 64;
+
+private:
+    // The masks for the operators in one direction, with operator i in
+    // bit i
+    struct Automaton {
+        // The operators that accept each character
+        uint64_t accepts[256];
+
+        // Operators that may repeat, and operators that may be skipped
+        uint64_t repeatable;
+        uint64_t optional;
+
+        // The states in which the automaton has matched: those after which
+        // every operator is optional
+        uint64_t final;
+    };
+
+    bool active;
+    bool matchesEmpty;
+    Automaton forward, reverse;
+
+    static void compile(Automaton &automaton,
+                        const vector<RegexOperator *> &regex, bool reversed);
+    int longestEnd(string_view s, int start) const;
+
+public:
+    // The searcher is only active if there are between 1 and MAX_OPERATORS
+    // operators, and each one is repeated once, ?, * or +.
+    ShiftAndSearcher(const vector<RegexOperator *> &regex);
+
+    // Reports whether a searcher for the regex would be active, without
+    // building its tables
+    static bool canSearch(const vector<RegexOperator *> &regex);
+
+    bool isActive() const;
+
+    Range findAtIndex(string_view s, int start) const;
+    Range find(string_view s, int start = 0) const;
+    bool match(string_view s) const;
+};
+
+
+#endif // SHIFTAND_H
@@ -0,0 +1,374 @@
+#ifndef STATIC_REGEX_H
+#define STATIC_REGEX_H
+
+#include "prefilter.h"
+#include "regex.h"
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+
+/* One operator of a pattern parsed at compile time.  It holds the same
+ * information as a RegexOperator, but as a plain value, so that a whole
+ * parsed pattern can be a constexpr array.
+ */
+struct StaticOp {
+    enum Kind { CHAR, ANY, CLASS };
+
+    Kind kind = CHAR;
+    char c = 0;
+
+    // The characters matched by a CLASS operator, as a 256-bit bitmap
+    uint64_t bits[4] = {0, 0, 0, 0};
+
+    // The repeat counts, with the same meaning as for RegexOperator
+    int minRepeat = 1, maxRepeat = 1;
+
+    constexpr void add(unsigned char ch) {
+        bits[ch >> 6] |= (uint64_t) 1 << (ch & 63);
+    }
+
+    constexpr bool matches(unsigned char ch) const {
+        switch (kind) {
+        case CHAR:
+            return ch == (unsigned char) c;
+        case ANY:
+            return true;
+        default:
+            return (bits[ch >> 6] >> (ch & 63)) & 1;
+        }
+    }
+};
+
+
+/* Returns the length of a null-terminated pattern. */
+constexpr int staticPatternLength(const char *expr) {
+    int length = 0;
+    while (expr[length] != 0)
+        length++;
+    return length;
+}
+
+
+/* Parse the decimal number at expr[j], advancing j past it, the same way
+ * parseRepeat() does.  Returns -1 if there are no digits there.
+ */
+constexpr int parseStaticCount(const char *expr, int length, int &j) {
+    int n = -1;
+    while (j < length && expr[j] >= '0' && expr[j] <= '9') {
+        n = (n < 0 ? 0 : n) * 10 + (expr[j] - '0');
+        if (n > MAX_REPEAT_COUNT)
+            n = MAX_REPEAT_COUNT + 1;
+        j++;
+    }
+    return n;
+}
+
+
+/* Parse the operator that starts at expr[i] into op, the same way
+ * parseRegex() does, and return the index just past it.  A character class
+ * with no closing bracket, a trailing \, a group, an alternation or an
+ * invalid repeat count can't be parsed, which stops the compile.
+ */
+constexpr int parseStaticOp(const char *expr, int length, int i,
+                            StaticOp &op) {
+    op = StaticOp();
+
+    char c = expr[i];
+    if (c == '(' || c == ')' || c == '|') {
+        throw invalid_argument("groups and alternation need a Regex");
+    }
+    else if (c == '.') {
+        op.kind = StaticOp::ANY;
+    }
+    else if (c == '\\') {
+        if (i + 1 >= length)
+            throw invalid_argument("pattern ends with an escape");
+        i++;
+        op.c = expr[i];
+    }
+    else if (c == '[') {
+        bool exclude = expr[i + 1] == '^';
+        int first = exclude ? i + 2 : i + 1;
+        while (expr[i] != ']') {
+            if (i >= length)
+                throw invalid_argument("unterminated character class");
+            i++;
+        }
+
+        op.kind = StaticOp::CLASS;
+        for (int j = first; j < i; j++)
+            op.add((unsigned char) expr[j]);
+        if (exclude) {
+            for (int w = 0; w < 4; w++)
+                op.bits[w] = ~op.bits[w];
+        }
+    }
+    else {
+        op.c = c;
+    }
+
+    if (i < length - 1) {
+        switch (expr[i + 1]) {
+        case '?':
+            op.minRepeat = 0;
+            op.maxRepeat = 1;
+            i++;
+            break;
+        case '*':
+            op.minRepeat = 0;
+            op.maxRepeat = -1;
+            i++;
+            break;
+        case '+':
+            op.minRepeat = 1;
+            op.maxRepeat = -1;
+            i++;
+            break;
+        case '{': {
+            int j = i + 2;
+            int low = parseStaticCount(expr, length, j), high = low;
+            if (low != -1 && j < length && expr[j] == ',') {
+                j++;
+                high = parseStaticCount(expr, length, j);
+            }
+            if (low == -1 || j >= length || expr[j] != '}')
+                break;
+
+            if (low > MAX_REPEAT_COUNT || high > MAX_REPEAT_COUNT)
+                throw invalid_argument("repeat count is too large");
+            if (high != -1 && high < low)
+                throw invalid_argument("repeat count maximum is less than "
+                                       "minimum");
+            op.minRepeat = low;
+            op.maxRepeat = high;
+            i = j;
+            break;
+        }
+        }
+    }
+    return i + 1;
+}
+
+
+/* Returns the number of operators in the pattern. */
+constexpr int countStaticOps(const char *expr) {
+    int length = staticPatternLength(expr);
+    int n = 0;
+    for (int i = 0; i < length; n++) {
+        StaticOp op;
+        i = parseStaticOp(expr, length, i, op);
+    }
+    return n;
+}
+
+
+/* Parse the pattern into its N operators. */
+template <int N>
+constexpr array<StaticOp, N> parseStaticOps(const char *expr) {
+    int length = staticPatternLength(expr);
+    array<StaticOp, N> ops{};
+    for (int i = 0, n = 0; i < length; n++)
+        i = parseStaticOp(expr, length, i, ops[n]);
+    return ops;
+}
+
+
+/* A regex parsed entirely at compile time.  The pattern is a template
+ * argument, which in C++17 has to be a character array with static storage
+ * duration:
+ *
+ *     static constexpr char pattern[] = "ab+c?";
+ *     Range r = StaticRegex<pattern>::find(s);
+ *
+ * The matcher is generated from the operators, one function per operator,
+ * with each operator's character test and repeat counts as constants, so the
+ * compiler can inline the whole search into straight-line code with no heap
+ * operators and no virtual calls.  It uses the same greedy backtracking as
+ * the runtime engines, so it finds exactly the same matches, and like the
+ * original backtracker it can take exponential time on patterns with many
+ * repeated operators.
+ */
+template <const char *Pattern>
+class StaticRegex {
+    static constexpr int N = countStaticOps(Pattern);
+    static constexpr array<StaticOp, N> ops = parseStaticOps<N>(Pattern);
+
+    // The shortest match, and the characters a non-empty match can start
+    // with; see PatternAnalysis
+    static constexpr int minLength() {
+        int n = 0;
+        for (const StaticOp &op : ops)
+            n += op.minRepeat;
+        return n;
+    }
+
+    // The pattern's required literal; see LiteralPrefilter
+    struct Literal {
+        array<char, N + 1> chars{};
+        int length = 0;
+        int minOffset = 0, maxOffset = 0;
+    };
+
+    static constexpr Literal requiredLiteral() {
+        Literal best, run;
+        int minBefore = 0, maxBefore = 0;
+
+        for (int i = 0; i <= N; i++) {
+            bool extendsRun = i < N && ops[i].kind == StaticOp::CHAR &&
+                ops[i].minRepeat > 0;
+
+            if (extendsRun && run.length == 0) {
+                run.minOffset = minBefore;
+                run.maxOffset = maxBefore;
+            }
+            if (extendsRun)
+                run.chars[run.length++] = ops[i].c;
+
+            if (!extendsRun || ops[i].minRepeat != ops[i].maxRepeat) {
+                if (run.length > best.length)
+                    best = run;
+                run = Literal();
+            }
+
+            if (i < N) {
+                minBefore += ops[i].minRepeat;
+                if (maxBefore != -1 && ops[i].maxRepeat != -1)
+                    maxBefore += ops[i].maxRepeat;
+                else
+                    maxBefore = -1;
+            }
+        }
+        return best;
+    }
+
+    static constexpr StaticOp firstChars() {
+        StaticOp first;
+        first.kind = StaticOp::CLASS;
+        for (const StaticOp &op : ops) {
+            for (int ch = 0; ch < 256; ch++) {
+                if (op.matches((unsigned char) ch))
+                    first.add((unsigned char) ch);
+            }
+            if (op.minRepeat > 0)
+                break;
+        }
+        return first;
+    }
+
+    // Match operators I onward, starting at s[pos].  On success, end is set
+    // to the end of the match.
+    template <int I>
+    static bool matchFrom(const char *s, int length, int pos, int &end) {
+        if constexpr (I == N) {
+            end = pos;
+            return true;
+        }
+        else {
+            constexpr StaticOp op = ops[I];
+
+            int limit = length - pos;
+            if (op.maxRepeat != -1 && op.maxRepeat < limit)
+                limit = op.maxRepeat;
+
+            // Apply the operator as many times as possible, then give back
+            // one character at a time until the rest of the pattern matches.
+            int n = 0;
+            if constexpr (op.kind == StaticOp::ANY) {
+                n = limit;
+            }
+            else {
+                while (n < limit && op.matches((unsigned char) s[pos + n]))
+                    n++;
+            }
+
+            for (; n >= op.minRepeat; n--) {
+                if (matchFrom<I + 1>(s, length, pos + n, end))
+                    return true;
+            }
+            return false;
+        }
+    }
+
+public:
+    // The number of operators in the pattern
+    static constexpr int size() {
+        return N;
+    }
+
+    /* Find the match starting at the specified index.  The match may be
+     * empty.  If there is no match at the index, the range (-1, -1) is
+     * returned.
+     */
+    static Range findAtIndex(string_view s, int start) {
+        int end;
+        if (matchFrom<0>(s.data(), (int) s.length(), start, end))
+            return Range(start, end);
+        return Range(-1, -1);
+    }
+
+    /* Find the first non-empty match in the string, skipping indexes that
+     * can't start one because they are too close to the end, or start with
+     * the wrong character, or are too far from the required literal.
+     */
+    static Range find(string_view s) {
+        static constexpr int needed = minLength() > 0 ? minLength() : 1;
+        static constexpr StaticOp first = firstChars();
+        static constexpr Literal literal = requiredLiteral();
+
+        const char *data = s.data();
+        int length = (int) s.length();
+        int literalPos = -1;
+
+        for (int i = 0; i <= length - needed; i++) {
+            if constexpr (literal.length > 0) {
+                if (literalPos < i + literal.minOffset) {
+                    const char *p = findLiteral(data + i + literal.minOffset,
+                                                data + length,
+                                                literal.chars.data(),
+                                                literal.length);
+                    if (p == nullptr)
+                        break;
+                    literalPos = (int) (p - data);
+                }
+                if (literal.maxOffset != -1 &&
+                    i < literalPos - literal.maxOffset) {
+                    i = literalPos - literal.maxOffset;
+                    if (i > length - needed)
+                        break;
+                }
+            }
+
+            int end;
+            if (first.matches((unsigned char) data[i]) &&
+                matchFrom<0>(data, length, i, end) && end != i) {
+                return Range(i, end);
+            }
+        }
+        return Range(-1, -1);
+    }
+
+    /* Reports whether the regex matches the entire string. */
+    static bool match(string_view s) {
+        int end;
+        return !s.empty() && matchFrom<0>(s.data(), (int) s.length(), 0, end)
+            && end == (int) s.length();
+    }
+
+    // The same, for input that isn't in a string
+    static Range findAtIndex(const char *data, size_t length, int start) {
+        return findAtIndex(string_view(data, length), start);
+    }
+
+    static Range find(const char *data, size_t length) {
+        return find(string_view(data, length));
+    }
+
+    static bool match(const char *data, size_t length) {
+        return match(string_view(data, length));
+    }
+};
+
+
+#endif // STATIC_REGEX_H
@@ -0,0 +1,141 @@
+#include "stream.h"
+
+
+StreamMatcher::StreamMatcher(const Regex &regex, Callback onMatch) :
+    prog(regex.getProgram()), onMatch(move(onMatch)),
+    notFirstChars(regex.getAnalysis().getFirstChars().complement()),
+    filtersFirstChar(notFirstChars.count() > 0),
+    initial(prog.threadSize(), 0), clist(prog), nlist(prog),
+    bufferStart(0) {
+    restart(0);
+}
+
+
+/* Advance every thread over the character at the current position, which is
+ * -1 at the end of the stream.  This is one iteration of PikeVM::run().
+ */
+void StreamMatcher::step(int c) {
+    clist.step(c, position + 1, nlist,
+               [&](const NFAThreadList<int64_t>::Thread &t) {
+        if (t.start == position)
+            return false;
+
+        // Record the match, and cut off all lower-priority threads.
+        matched = StreamMatch{t.start, position};
+        return true;
+    });
+
+    clist.swap(nlist);
+    nlist.clear();
+}
+
+
+/* Forget every thread and the pending match, and start searching again at
+ * the specified offset.
+ */
+void StreamMatcher::restart(int64_t from) {
+    position = from;
+    matched = StreamMatch{-1, -1};
+
+    clist.reset();
+    nlist.reset();
+}
+
+
+/* Scan the input from the current position to the end of data, which holds
+ * the stream from offset base on.  Whenever the pending match can no longer
+ * get longer, it is reported, and the search goes back to its end.
+ */
+void StreamMatcher::scan(string_view data, int64_t base, bool atEnd) {
+    int64_t end = base + (int64_t) data.length();
+
+    for (;;) {
+        bool done = false;
+
+        while (!done && position < end) {
+            // Start a new thread here, if we are still looking for a
+            // starting point.  While there are no other threads, skip
+            // straight to a character that can start a match.
+            if (matched.start == -1) {
+                if (clist.empty() && filtersFirstChar) {
+                    const char *p = data.data() + (position - base);
+                    position += findFirstNonMember(notFirstChars, p,
+                        data.data() + data.length()) - p;
+                    if (position == end)
+                        break;
+                }
+                clist.add(initial.data(), position, position);
+            }
+
+            step((unsigned char) data[position - base]);
+            position++;
+            done = matched.start != -1 && clist.empty();
+        }
+
+        // At the end of the stream, threads waiting to match can finish.
+        if (!done && atEnd && position == end) {
+            step(-1);
+            done = matched.start != -1;
+        }
+
+        if (!done)
+            return;
+
+        onMatch(matched);
+        restart(matched.end);
+    }
+}
+
+
+/* Keep the part of data, which holds the stream from offset base on, that a
+ * later search may have to go back to.
+ */
+void StreamMatcher::keep(string_view data, int64_t base) {
+    int64_t from = matched.start != -1 ? matched.end : position;
+
+    if (data.data() == buffer.data())
+        buffer.erase(0, from - base);
+    else
+        buffer.assign(data.substr(from - base));
+    bufferStart = from;
+}
+
+
+void StreamMatcher::feed(string_view chunk) {
+    // Scan the chunk where it is, unless there is earlier input to go back
+    // over.
+    if (buffer.empty()) {
+        int64_t base = position;
+        scan(chunk, base, false);
+        keep(chunk, base);
+    }
+    else {
+        buffer.append(chunk);
+        scan(buffer, bufferStart, false);
+        keep(buffer, bufferStart);
+    }
+}
+
+
+void StreamMatcher::feed(const char *data, size_t length) {
+    feed(string_view(data, length));
+}
+
+
+void StreamMatcher::finish() {
+    scan(buffer, bufferStart, true);
+
+    buffer.clear();
+    bufferStart = 0;
+    restart(0);
+}
+
+
+int64_t StreamMatcher::getPosition() const {
+    return position;
+}
+
+
+size_t StreamMatcher::getBufferedBytes() const {
+    return buffer.size();
+}
@@ -0,0 +1,82 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "matcher.h"
+
+#include <cstdint>
+#include <functional>
+
+
+/* A match found in a stream, as offsets from the start of the stream.  They
+ * are 64 bits wide, since streams can be far longer than any one string.
+ */
+struct StreamMatch {
+    int64_t start, end;
+};
+
+
+/* Finds the matches of a Regex in input that arrives in chunks of any size,
+ * such as data read from a pipe.  The matches are the same ones findAll()
+ * would report on the whole stream, including matches that span chunks, and
+ * each is passed to the callback as soon as no later input can change it.
+ *
+ * The search is a Pike VM whose threads carry their start offsets with them,
+ * so input is not kept once it has been scanned, with one exception: while a
+ * match has been found but could still get longer, the input after its end
+ * is kept, since the search resumes from there if the match doesn't grow.
+ * For a pattern with a bounded match length, that is never more than the
+ * longest match.
+ *
+ * A StreamMatcher may only be used by one thread at a time.
+ */
+class StreamMatcher {
+public:
+    using Callback = function<void(const StreamMatch &)>;
+
+private:
+    const NFAProgram &prog;
+    Callback onMatch;
+
+    // The characters that can't start a non-empty match, for skipping
+    // ahead while no thread is running
+    CharSet notFirstChars;
+    bool filtersFirstChar;
+
+    // The thread that starts a match, as in PikeVM
+    vector<int> initial;
+
+    // The threads at the current and next offset, as in PikeVM
+    NFAThreadList<int64_t> clist, nlist;
+
+    // The offset of the next character to scan, and the best match found
+    // so far, which might still get longer, or (-1, -1)
+    int64_t position;
+    StreamMatch matched;
+
+    // The input kept after the end of the pending match, and its offset
+    string buffer;
+    int64_t bufferStart;
+
+    void step(int c);
+    void restart(int64_t from);
+    void scan(string_view data, int64_t base, bool atEnd);
+    void keep(string_view data, int64_t base);
+
+public:
+    StreamMatcher(const Regex &regex, Callback onMatch);
+
+    // Scan the next chunk of the stream.
+    void feed(string_view chunk);
+    void feed(const char *data, size_t length);
+
+    // End the stream, reporting the matches still pending.  The matcher is
+    // then ready for a new stream, starting again at offset 0.
+    void finish();
+
+    // The number of characters fed so far, and how many of them are kept
+    int64_t getPosition() const;
+    size_t getBufferedBytes() const;
+};
+
+
+#endif // STREAM_H
@@ -0,0 +1,141 @@
+#include "syntax.h"
+
+#include <stdexcept>
+
+
+SyntaxNode::SyntaxNode(Kind kind) : kind(kind), minRepeat(1), maxRepeat(1) {
+    // Nothing else to do.
+}
+
+
+bool hasGroups(const string &expr) {
+    for (int i = 0; i < (int) expr.length(); i++) {
+        char c = expr[i];
+        if (c == '\\') {
+            i = escapedChar(expr, i);
+        }
+        else if (c == '[') {
+            i = classEnd(expr, i);
+        }
+        else if (c == '(' || c == ')' || c == '|') {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* A recursive descent parser over the grammar
+ *
+ *     alternation := sequence ( '|' sequence )*
+ *     sequence    := ( atom repeat? )*
+ *     atom        := '(' alternation ')' | '.' | '[' ... ']' | '\' c | c
+ */
+class SyntaxParser {
+    const string &expr;
+    int pos;
+
+    unique_ptr<SyntaxNode> parseAlternation();
+    unique_ptr<SyntaxNode> parseSequence();
+    unique_ptr<SyntaxNode> parseAtom();
+
+public:
+    SyntaxParser(const string &expr) : expr(expr), pos(0) {}
+
+    unique_ptr<SyntaxNode> parse();
+};
+
+
+unique_ptr<SyntaxNode> SyntaxParser::parse() {
+    unique_ptr<SyntaxNode> root = parseAlternation();
+    if (pos < (int) expr.length())
+        throw invalid_argument("unmatched ) in pattern");
+    return root;
+}
+
+
+unique_ptr<SyntaxNode> SyntaxParser::parseAlternation() {
+    unique_ptr<SyntaxNode> first = parseSequence();
+    if (pos == (int) expr.length() || expr[pos] != '|')
+        return first;
+
+    auto node = make_unique<SyntaxNode>(SyntaxNode::ALTERNATE);
+    node->children.push_back(move(first));
+    while (pos < (int) expr.length() && expr[pos] == '|') {
+        pos++;
+        node->children.push_back(parseSequence());
+    }
+    return node;
+}
+
+
+unique_ptr<SyntaxNode> SyntaxParser::parseSequence() {
+    auto node = make_unique<SyntaxNode>(SyntaxNode::CONCAT);
+
+    while (pos < (int) expr.length() && expr[pos] != '|' &&
+           expr[pos] != ')') {
+        unique_ptr<SyntaxNode> atom = parseAtom();
+
+        // The atom's last character is just before pos.
+        int minRepeat, maxRepeat;
+        pos = parseRepeat(expr, pos - 1, minRepeat, maxRepeat) + 1;
+        if (minRepeat != 1 || maxRepeat != 1) {
+            auto repeat = make_unique<SyntaxNode>(SyntaxNode::REPEAT);
+            repeat->minRepeat = minRepeat;
+            repeat->maxRepeat = maxRepeat;
+            repeat->children.push_back(move(atom));
+            atom = move(repeat);
+        }
+        node->children.push_back(move(atom));
+    }
+
+    if (node->children.size() == 1)
+        return move(node->children[0]);
+    return node;
+}
+
+
+/* Parse the atom at pos, leaving pos just past it. */
+unique_ptr<SyntaxNode> SyntaxParser::parseAtom() {
+    char c = expr[pos];
+
+    if (c == '(') {
+        pos++;
+        unique_ptr<SyntaxNode> group = parseAlternation();
+        if (pos == (int) expr.length())
+            throw invalid_argument("unmatched ( in pattern");
+        pos++;
+        return group;
+    }
+
+    auto node = make_unique<SyntaxNode>(SyntaxNode::CHARS);
+    if (c == '.') {
+        node->chars.addAll();
+    }
+    else if (c == '\\') {
+        pos = escapedChar(expr, pos);
+        node->chars.add((unsigned char) expr[pos]);
+    }
+    else if (c == '[') {
+        int end = classEnd(expr, pos);
+
+        bool exclude = expr[pos + 1] == '^';
+        int first = exclude ? pos + 2 : pos + 1;
+        if (first < end)
+            node->chars.add(expr.data() + first, end - first);
+        if (exclude)
+            node->chars = node->chars.complement();
+        pos = end;
+    }
+    else {
+        node->chars.add((unsigned char) c);
+    }
+
+    pos++;
+    return node;
+}
+
+
+unique_ptr<SyntaxNode> parseSyntax(const string &expr) {
+    return SyntaxParser(expr).parse();
+}
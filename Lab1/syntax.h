@@ -0,0 +1,46 @@
+#ifndef SYNTAX_H
+#define SYNTAX_H
+
+#include "regex.h"
+
+#include <memory>
+
+
+/* A node of the syntax tree of a pattern with groups or alternation, which
+ * can't be written as a flat sequence of operators.
+ *
+ * A CHARS node consumes one character from its set.  A CONCAT node matches
+ * its children one after another, and matches the empty string if it has no
+ * children.  An ALTERNATE node matches any one of its children, preferring
+ * the earlier ones.  A REPEAT node matches its one child between minRepeat
+ * and maxRepeat times, with the same meaning as for a RegexOperator,
+ * preferring more repetitions to fewer.
+ */
+struct SyntaxNode {
+    enum Kind { CHARS, CONCAT, ALTERNATE, REPEAT };
+
+    Kind kind;
+    CharSet chars;
+    vector<unique_ptr<SyntaxNode>> children;
+    int minRepeat, maxRepeat;
+
+    SyntaxNode(Kind kind);
+};
+
+
+// Reports whether the pattern uses groups or alternation, i.e. has a (, ) or
+// | that isn't escaped or in a character class.  Patterns that don't are
+// parsed by parseRegex() instead.  Throws invalid_argument if a character
+// class or escape before the first group is unterminated, just as either
+// parser would.
+bool hasGroups(const string &expr);
+
+// Parse a pattern made of the atoms parseRegex() accepts, each with an
+// optional repeat, plus groups in parentheses, which may be repeated too,
+// and alternatives separated by |.  Throws invalid_argument if the
+// parentheses are unbalanced, a character class or escape is unterminated,
+// or a repeat count is invalid.
+unique_ptr<SyntaxNode> parseSyntax(const string &expr);
+
+
+#endif // SYNTAX_H
@@ -0,0 +1,292 @@
+#include "teddy.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define TEDDY_X86 1
+#include <immintrin.h>
+#endif
+
+
+TeddyScanner::TeddyScanner(const vector<string> &literals, Kernel kernel) :
+    literals(literals), kernel(kernel), numMasks(3) {
+
+    if (literals.empty() || literals.size() > MAX_LITERALS)
+        throw invalid_argument("Teddy needs between 1 and 64 literals");
+    for (const string &literal : literals) {
+        if (literal.empty())
+            throw invalid_argument("Teddy can't search for an empty literal");
+        numMasks = min(numMasks, (int) literal.length());
+    }
+
+    // Literals that sort next to each other tend to share leading bytes, so
+    // put them in the same bucket, where they set fewer bits between them.
+    vector<int> order(literals.size());
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [&](int a, int b) {
+        return literals[a] < literals[b];
+    });
+
+    memset(masks, 0, sizeof(masks));
+    for (size_t rank = 0; rank < order.size(); rank++) {
+        int i = order[rank];
+        int b = (int) (rank * NUM_BUCKETS / order.size());
+        buckets[b].push_back(i);
+
+        for (int j = 0; j < numMasks; j++) {
+            unsigned char c = (unsigned char) literals[i][j];
+            masks[j][0][c & 0x0F] |= 1 << b;
+            masks[j][1][c >> 4] |= 1 << b;
+        }
+    }
+}
+
+
+TeddyScanner::Kernel TeddyScanner::bestKernel() {
+#ifdef TEDDY_X86
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    static const bool hasSSSE3 = __builtin_cpu_supports("ssse3");
+    if (hasAVX2)
+        return AVX2;
+    if (hasSSSE3)
+        return SSSE3;
+#endif
+    return SCALAR;
+}
+
+
+int TeddyScanner::size() const {
+    return (int) literals.size();
+}
+
+
+TeddyScanner::Kernel TeddyScanner::getKernel() const {
+    return kernel;
+}
+
+
+/* Returns the first position in [begin, end) where the first numMasks bytes
+ * could be the start of a literal, and sets buckets to the buckets the
+ * literal could be in; or returns nullptr if there isn't one.
+ */
+static const char * findCandidateScalar(const uint8_t masks[3][2][16],
+                                        int numMasks, const char *begin,
+                                        const char *end, uint8_t &buckets) {
+    for (const char *p = begin; end - p >= numMasks; p++) {
+        uint8_t bits = 0xFF;
+        for (int j = 0; j < numMasks; j++) {
+            unsigned char c = (unsigned char) p[j];
+            bits &= masks[j][0][c & 0x0F] & masks[j][1][c >> 4];
+        }
+        if (bits != 0) {
+            buckets = bits;
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+
+#ifdef TEDDY_X86
+
+/* The same as findCandidateScalar(), 32 positions at a time.  The byte
+ * shuffles only look within each 128-bit lane, so the tables are copied
+ * into both lanes.
+ */
+__attribute__((target("avx2")))
+static const char * findCandidateAVX2(const uint8_t masks[3][2][16],
+                                      int numMasks, const char *begin,
+                                      const char *end, uint8_t &buckets) {
+    const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i low[3], high[3];
+    for (int j = 0; j < numMasks; j++) {
+        low[j] = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *) masks[j][0]));
+        high[j] = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *) masks[j][1]));
+    }
+
+    const char *p = begin;
+    for (; end - p >= 32 + numMasks - 1; p += 32) {
+        __m256i bits = _mm256_set1_epi8(-1);
+        for (int j = 0; j < numMasks; j++) {
+            __m256i v = _mm256_loadu_si256((const __m256i *) (p + j));
+            __m256i lo = _mm256_and_si256(v, nibbleMask);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4),
+                                          nibbleMask);
+            bits = _mm256_and_si256(bits, _mm256_and_si256(
+                _mm256_shuffle_epi8(low[j], lo),
+                _mm256_shuffle_epi8(high[j], hi)));
+        }
+
+        uint32_t mask = ~(uint32_t) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(bits, zero));
+        if (mask != 0) {
+            alignas(32) uint8_t lanes[32];
+            _mm256_store_si256((__m256i *) lanes, bits);
+            int i = __builtin_ctz(mask);
+            buckets = lanes[i];
+            return p + i;
+        }
+    }
+
+    return findCandidateScalar(masks, numMasks, p, end, buckets);
+}
+
+
+/* The same as findCandidateAVX2(), 16 positions at a time. */
+__attribute__((target("ssse3")))
+static const char * findCandidateSSSE3(const uint8_t masks[3][2][16],
+                                       int numMasks, const char *begin,
+                                       const char *end, uint8_t &buckets) {
+    const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i low[3], high[3];
+    for (int j = 0; j < numMasks; j++) {
+        low[j] = _mm_loadu_si128((const __m128i *) masks[j][0]);
+        high[j] = _mm_loadu_si128((const __m128i *) masks[j][1]);
+    }
+
+    const char *p = begin;
+    for (; end - p >= 16 + numMasks - 1; p += 16) {
+        __m128i bits = _mm_set1_epi8(-1);
+        for (int j = 0; j < numMasks; j++) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (p + j));
+            __m128i lo = _mm_and_si128(v, nibbleMask);
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibbleMask);
+            bits = _mm_and_si128(bits, _mm_and_si128(
+                _mm_shuffle_epi8(low[j], lo), _mm_shuffle_epi8(high[j], hi)));
+        }
+
+        uint32_t mask = ~(uint32_t) _mm_movemask_epi8(
+            _mm_cmpeq_epi8(bits, zero)) & 0xFFFF;
+        if (mask != 0) {
+            alignas(16) uint8_t lanes[16];
+            _mm_store_si128((__m128i *) lanes, bits);
+            int i = __builtin_ctz(mask);
+            buckets = lanes[i];
+            return p + i;
+        }
+    }
+
+    return findCandidateScalar(masks, numMasks, p, end, buckets);
+}
+
+#endif // TEDDY_X86
+
+
+int TeddyScanner::next(string_view s, int from, uint64_t &found) const {
+    const char *begin = s.data();
+    const char *end = begin + s.length();
+    if (from > (int) s.length())
+        return -1;
+
+    for (const char *p = begin + from; p < end; p++) {
+        uint8_t bits = 0;
+        switch (kernel) {
+#ifdef TEDDY_X86
+        case AVX2:
+            p = findCandidateAVX2(masks, numMasks, p, end, bits);
+            break;
+        case SSSE3:
+            p = findCandidateSSSE3(masks, numMasks, p, end, bits);
+            break;
+#endif
+        default:
+            p = findCandidateScalar(masks, numMasks, p, end, bits);
+            break;
+        }
+        if (p == nullptr)
+            return -1;
+
+        // Compare the candidate buckets' literals in full.
+        found = 0;
+        for (int b = 0; b < NUM_BUCKETS; b++) {
+            if ((bits >> b & 1) == 0)
+                continue;
+            for (int i : buckets[b]) {
+                const string &literal = literals[i];
+                if ((size_t) (end - p) >= literal.length() &&
+                    memcmp(p, literal.data(), literal.length()) == 0)
+                    found |= (uint64_t) 1 << i;
+            }
+        }
+        if (found != 0)
+            return (int) (p - begin);
+    }
+    return -1;
+}
+
+
+MultiFinder::MultiFinder(const vector<const Regex *> &regexes) {
+    vector<string> literals;
+    for (int k = 0; k < (int) regexes.size(); k++) {
+        matchers.push_back(make_unique<Matcher>(*regexes[k]));
+
+        string prefix = literalPrefix(regexes[k]->getOperators());
+        if (!prefix.empty() && literals.size() < TeddyScanner::MAX_LITERALS) {
+            literals.push_back(prefix);
+            literalRegex.push_back(k);
+        }
+        else {
+            unscanned.push_back(k);
+        }
+    }
+
+    if (!literals.empty())
+        scanner = make_unique<TeddyScanner>(literals);
+}
+
+
+vector<Range> MultiFinder::find(string_view s) {
+    vector<Range> result(matchers.size(), Range(-1, -1));
+
+    if (scanner) {
+        // The literals whose regexes haven't matched yet
+        int n = scanner->size();
+        uint64_t pending = n == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << n) - 1;
+
+        uint64_t found;
+        int p = scanner->next(s, 0, found);
+        while (p != -1) {
+            for (found &= pending; found != 0; found &= found - 1) {
+                int i = __builtin_ctzll(found);
+                int k = literalRegex[i];
+
+                Range r = matchers[k]->findAtIndex(s, p);
+                if (r.start != -1 && r.end > r.start) {
+                    result[k] = r;
+                    pending &= ~((uint64_t) 1 << i);
+                }
+            }
+
+            if (pending == 0)
+                break;
+            p = scanner->next(s, p + 1, found);
+        }
+    }
+
+    for (int k : unscanned)
+        result[k] = matchers[k]->find(s);
+    return result;
+}
+
+
+string literalPrefix(const vector<RegexOperator *> &regex) {
+    string prefix;
+    for (const RegexOperator *op : regex) {
+        const MatchChar *mc = dynamic_cast<const MatchChar *>(op);
+        if (mc == nullptr || op->getMinRepeat() == 0)
+            break;
+
+        // A character repeated a variable number of times ends the prefix.
+        prefix.append(op->getMinRepeat(), mc->getChar());
+        if (op->getMinRepeat() != op->getMaxRepeat())
+            break;
+    }
+    return prefix;
+}
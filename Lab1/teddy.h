@@ -0,0 +1,98 @@
+#ifndef TEDDY_H
+#define TEDDY_H
+
+#include "matcher.h"
+
+#include <cstdint>
+
+
+/* Finds where any of up to 64 short literals occur, with the Teddy algorithm.
+ *
+ * The literals are split into 8 buckets.  For each of the first few bytes of
+ * a literal (up to 3, and no more than the shortest literal has), there are
+ * two 16-entry tables, indexed by the low and the high nibble of a byte, in
+ * which bit b is set if some literal in bucket b can have that nibble there.
+ * A byte shuffle looks up 16 or 32 input bytes in a table at once, so ANDing
+ * the lookups for each nibble of each of the first bytes leaves, at every
+ * position, the buckets with a literal that could start there.  Only those
+ * buckets' literals are compared in full.
+ *
+ * The shuffles use AVX2 or SSSE3 if the processor has them, and otherwise
+ * the same tables are looked up one byte at a time.
+ */
+class TeddyScanner {
+public:
+    enum Kernel { SCALAR, SSSE3, AVX2 };
+
+    static constexpr int MAX_LITERALS = 64;
+    static constexpr int NUM_BUCKETS = 8;
+
+private:
+    vector<string> literals;
+    Kernel kernel;
+
+    // The number of leading bytes in the tables
+    int numMasks;
+
+    // masks[j][0] is indexed by the low nibble of the j-th byte of a
+    // position, and masks[j][1] by the high nibble
+    uint8_t masks[3][2][16];
+
+    // The literals in each bucket, as indexes into literals
+    vector<int> buckets[NUM_BUCKETS];
+
+public:
+    // Throws invalid_argument if there are no literals, more than
+    // MAX_LITERALS of them, or an empty one.
+    TeddyScanner(const vector<string> &literals,
+                 Kernel kernel = bestKernel());
+
+    // The fastest kernel the processor supports
+    static Kernel bestKernel();
+
+    int size() const;
+    Kernel getKernel() const;
+
+    // Returns the first index at or after from where at least one of the
+    // literals occurs, and sets found to the literals that occur there, one
+    // bit per literal; or returns -1 if there isn't one.
+    int next(string_view s, int from, uint64_t &found) const;
+};
+
+
+/* Finds the first match of each of many regexes in one scan of a string,
+ * when the regexes begin with literal prefixes.  The prefixes go into a
+ * TeddyScanner, and at each position where one occurs, only the regexes
+ * with that prefix are run.  Every match of a regex begins with its prefix,
+ * so the first position where it matches is its first match.
+ *
+ * Regexes with no literal prefix, and those beyond the scanner's limit, are
+ * searched on their own.  Like a Matcher, a MultiFinder may only be used by
+ * one thread at a time.
+ */
+class MultiFinder {
+    vector<unique_ptr<Matcher>> matchers;
+
+    // The regex each literal of the scanner is the prefix of, and the
+    // regexes that aren't scanned for
+    unique_ptr<TeddyScanner> scanner;
+    vector<int> literalRegex;
+    vector<int> unscanned;
+
+public:
+    // The regexes are not copied, and must outlive the finder.
+    MultiFinder(const vector<const Regex *> &regexes);
+
+    // The first non-empty match of each regex in the string, as find()
+    // would report it, or (-1, -1)
+    vector<Range> find(string_view s);
+};
+
+
+/* Returns the string every match of the regex begins with, which may be
+ * empty.
+ */
+string literalPrefix(const vector<RegexOperator *> &regex);
+
+
+#endif // TEDDY_H
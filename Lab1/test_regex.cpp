@@ -1,14 +1,160 @@
 #include "testbase.h"
+#include "approx.h"
+#include "cache.h"
 #include "engine.h"
+#include "grep.h"
+#include "matcher.h"
+#include "parallel.h"
+#include "regexset.h"
+#include "static_regex.h"
+#include "stream.h"
+#include "teddy.h"
 
 #include <algorithm>
-#include <cstdlib>
 #include <iostream>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <thread>
+#include <type_traits>
 
 
 using namespace std;
 
 
+/*===========================================================================
+ * HELPERS
+ */
+
+
+// Counts every allocation made through operator new, so that tests can check
+// that code paths don't allocate memory.  The replacements are built on
+// malloc() and free(), which GCC takes for a mismatch once it inlines them.
+static atomic<long> numAllocations(0);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void * operator new(size_t size) {
+    numAllocations++;
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+#pragma GCC diagnostic pop
+
+
+// Patterns and subjects used to cross-check the engines against each other.
+static const vector<string> CROSS_CHECK_PATTERNS = {
+    "abc", "a.c", "a[aegi]c", "a[^aegi]c", "a.*c", "a.+c", "ab?c",
+    "ab+c?d*[ef]+g[^ghi]*j.+k", "a*", "b?", ".*", "a*a*b", "[ab]*b?a+",
+    "a?a?a?aaa", "[^a]+b", "a+a+", ".?c.?", "\\.a", "\\[b\\]",
+    "[ab]?cd", ".*ab", "a?b?cd+e", "[^c]*ccb?", "abab", "k", "aaa"
+};
+
+
+/* Generate a deterministic set of short subject strings over a small
+ * alphabet, so that the patterns above hit plenty of partial matches.
+ */
+static vector<string> crossCheckSubjects() {
+    mt19937 rng(12345);
+    const string alphabet = "abcdefgijk.[]";
+    vector<string> subjects{""};
+    for (int i = 0; i < 400; i++) {
+        int length = rng() % 16;
+        string s;
+        for (int j = 0; j < length; j++)
+            s += alphabet[rng() % alphabet.length()];
+        subjects.push_back(s);
+    }
+    return subjects;
+}
+
+
+/* Reports whether the specified engine produces exactly the same results as
+ * the original backtracking algorithm, running directly over the operators,
+ * for every cross-check pattern and subject.
+ */
+static bool engineAgreesWithBacktracker(Engine engine) {
+    vector<string> subjects = crossCheckSubjects();
+    BacktrackContext context;
+    bool agree = true;
+
+    for (const string &pattern : CROSS_CHECK_PATTERNS) {
+        vector<RegexOperator *> regex = parseRegex(pattern);
+        for (const string &s : subjects) {
+            Range expected = findBacktrack(regex, s, context);
+            Range actual = find(regex, s, engine);
+            if (expected.start != actual.start || expected.end != actual.end)
+                agree = false;
+
+            bool expectedMatch = expected.start == 0 && expected.end > 0 &&
+                expected.end == (int) s.length();
+            if (expectedMatch != match(regex, s, engine))
+                agree = false;
+        }
+        clearRegex(regex);
+    }
+    return agree;
+}
+
+
+// Cross-check patterns for the compile-time regex, which need to be arrays
+// with static storage duration to be template arguments.
+static constexpr char STATIC_ABC[] = "abc";
+static constexpr char STATIC_DOT_STAR[] = "a.*c";
+static constexpr char STATIC_CLASSES[] = "[ab]*b?a+";
+static constexpr char STATIC_OPTIONAL[] = "a?a?a?aaa";
+static constexpr char STATIC_EXCLUDE[] = "[^c]*ccb?";
+static constexpr char STATIC_ESCAPES[] = "\\.a\\[";
+static constexpr char STATIC_COMPLEX[] = "ab+c?d*[ef]+g[^ghi]*j.+k";
+static constexpr char STATIC_INNER_LITERAL[] = "[^c]?.cd+";
+
+
+/* Reports whether the compile-time regex produces exactly the same results
+ * as the original backtracking algorithm for every cross-check subject.
+ */
+template <const char *Pattern>
+static bool staticAgreesWithBacktracker() {
+    vector<RegexOperator *> regex = parseRegex(Pattern);
+    BacktrackContext context;
+    bool agree = true;
+
+    for (const string &s : crossCheckSubjects()) {
+        Range expected = findBacktrack(regex, s, context);
+        Range actual = StaticRegex<Pattern>::find(s);
+        if (expected.start != actual.start || expected.end != actual.end)
+            agree = false;
+
+        bool expectedMatch = expected.start == 0 && expected.end > 0 &&
+            expected.end == (int) s.length();
+        if (expectedMatch != StaticRegex<Pattern>::match(s))
+            agree = false;
+
+        for (int i = 0; i <= (int) s.length(); i++) {
+            expected = findAtIndex(regex, s, i, context);
+            actual = StaticRegex<Pattern>::findAtIndex(s, i);
+            if (expected.start != actual.start || expected.end != actual.end)
+                agree = false;
+        }
+    }
+
+    clearRegex(regex);
+    return agree;
+}
+
+
 /*===========================================================================
  * TEST FUNCTIONS
  *
@@ -448,6 +594,2031 @@ void test_complex_regex(TestContext &ctx) {
 }
 
 
+/*! Test character-set bitmaps and the vectorized run scan. */
+void test_char_sets(TestContext &ctx) {
+    mt19937 rng(777);
+
+    ctx.DESC("Character set bitmaps");
+
+    CharSet set;
+    set.add("aeiou\xff\x80", 7);
+    ctx.CHECK(set.count() == 7);
+    ctx.CHECK(set.contains('a') && set.contains('u'));
+    ctx.CHECK(set.contains(0xff) && set.contains(0x80));
+    ctx.CHECK(!set.contains('b') && !set.contains(0) && !set.contains(0x7f));
+    ctx.CHECK(set.complement().count() == 249);
+    ctx.CHECK(!set.complement().contains('e'));
+
+    ctx.result();
+
+    ctx.DESC("Vectorized run scan agrees with scalar scan");
+
+    bool agree = true;
+    for (int trial = 0; trial < 200; trial++) {
+        // A random set, and a buffer mostly made of its members, so that
+        // runs are long enough to exercise the vector loops.
+        CharSet members;
+        int numMembers = 1 + rng() % 255;
+        for (int i = 0; i < numMembers; i++)
+            members.add((unsigned char) (rng() % 256));
+
+        string buffer;
+        for (int i = 0; i < 300; i++) {
+            unsigned char c = rng() % 256;
+            if (rng() % 64 != 0) {
+                while (!members.contains(c))
+                    c++;
+            }
+            buffer += (char) c;
+        }
+
+        for (int start = 0; start < 40; start++) {
+            const char *begin = buffer.data() + start;
+            const char *end = begin + rng() % (buffer.length() - start);
+            const char *expected = begin;
+            while (expected < end && members.contains(*expected))
+                expected++;
+            if (findFirstNonMember(members, begin, end) != expected)
+                agree = false;
+        }
+    }
+    ctx.CHECK(agree);
+
+    ctx.result();
+
+    Regex regex("x[abcdefghijklmnopqrstuvwxyz_\x80]+[^abcdefghijklmnopq]");
+    string s = "x" + string(100, 'q') + "\x80" + string(100, '_') + "r";
+
+    ctx.DESC("Long character classes");
+
+    Range r = Matcher(regex, Engine::BACKTRACK).find("!" + s);
+    ctx.CHECK(r.start == 1 && r.end == (int) s.length() + 1);
+    r = Matcher(regex, Engine::PIKE_VM).find("!" + s);
+    ctx.CHECK(r.start == 1 && r.end == (int) s.length() + 1);
+    ctx.CHECK(Matcher(regex, Engine::BACKTRACK).match(s));
+    ctx.CHECK(Matcher(regex, Engine::DFA).match(s));
+    ctx.CHECK(!Matcher(regex, Engine::DFA).match(s + "a"));
+
+    ctx.result();
+}
+
+
+/*! Test that the operator backtracker tracks repetitions as counts. */
+void test_repetition_runs(TestContext &ctx) {
+    BacktrackContext context;
+    Range r;
+
+    ctx.DESC("Long runs backtrack by count");
+
+    vector<RegexOperator *> any = parseRegex(".*x");
+    string s = string(1 << 20, 'a') + "x" + string(1000, 'a');
+    r = findAtIndex(any, s, 0, context);
+    ctx.CHECK(r.start == 0 && r.end == (1 << 20) + 1);
+    clearRegex(any);
+
+    vector<RegexOperator *> excluded = parseRegex("[^x]+a?a");
+    r = findAtIndex(excluded, s, 0, context);
+    ctx.CHECK(r.start == 0 && r.end == 1 << 20);
+    clearRegex(excluded);
+
+    ctx.result();
+
+    ctx.DESC("Context memory doesn't grow with the run length");
+
+    vector<RegexOperator *> star = parseRegex("a*b");
+    BacktrackContext fresh;
+    long before = numAllocations;
+    r = findAtIndex(star, s, 0, fresh);
+    ctx.CHECK(r.start == -1 && r.end == -1);
+    ctx.CHECK(numAllocations - before <= 3);
+    clearRegex(star);
+
+    ctx.result();
+}
+
+
+/*! Test parsing regexes into an arena. */
+void test_arena(TestContext &ctx) {
+    ctx.DESC("Arena-parsed operators live in one block");
+
+    const string pattern = "ab+c?d*[ef]+g[^ghi]*j.+k";
+    RegexArena arena;
+    long before = numAllocations;
+    vector<RegexOperator *> regex = parseRegex(pattern, arena);
+
+    // One allocation for the block, and one for the pointer vector
+    ctx.CHECK(numAllocations - before == 2);
+    ctx.CHECK(regex.size() == 10);
+
+    const char *lowest = (const char *) regex[0];
+    for (RegexOperator *op : regex) {
+        const char *p = (const char *) op;
+        ctx.CHECK(p >= lowest && p < lowest + arena.getUsed());
+    }
+
+    ctx.result();
+
+    ctx.DESC("Arena-parsed operators match like heap-parsed ones");
+
+    vector<string> subjects = crossCheckSubjects();
+    BacktrackContext context;
+    bool agree = true;
+    for (const string &p : CROSS_CHECK_PATTERNS) {
+        vector<RegexOperator *> heap = parseRegex(p);
+        vector<RegexOperator *> arenaOps = parseRegex(p, arena);
+        for (const string &s : subjects) {
+            Range a = findBacktrack(heap, s, context);
+            Range b = findBacktrack(arenaOps, s, context);
+            if (a.start != b.start || a.end != b.end)
+                agree = false;
+        }
+        clearRegex(heap);
+    }
+    ctx.CHECK(agree);
+
+    ctx.result();
+
+    ctx.DESC("Unterminated classes and trailing escapes are rejected");
+
+    int numThrown = 0;
+    const char *malformed[] = {"[abc", "ab[", "[^", "a\\", "\\"};
+    for (const char *p : malformed) {
+        try {
+            parseRegex(p);
+        } catch (const invalid_argument &) {
+            numThrown++;
+        }
+        try {
+            parseRegex(p, arena);
+        } catch (const invalid_argument &) {
+            numThrown++;
+        }
+        try {
+            Regex regex(p);
+        } catch (const invalid_argument &) {
+            numThrown++;
+        }
+    }
+    ctx.CHECK(numThrown == 15);
+
+    ctx.result();
+}
+
+
+/*! Test the static analysis of match lengths and first characters. */
+void test_analysis(TestContext &ctx) {
+    ctx.DESC("Match lengths and first characters");
+
+    Regex fixed("ab[cd]");
+    ctx.CHECK(fixed.getAnalysis().getMinLength() == 3);
+    ctx.CHECK(fixed.getAnalysis().getMaxLength() == 3);
+    ctx.CHECK(fixed.getAnalysis().getFirstChars().count() == 1);
+    ctx.CHECK(fixed.getAnalysis().getFirstChars().contains('a'));
+
+    Regex optional("a?[xy]?b+c*.?");
+    ctx.CHECK(optional.getAnalysis().getMinLength() == 1);
+    ctx.CHECK(optional.getAnalysis().getMaxLength() == -1);
+    ctx.CHECK(optional.getAnalysis().getFirstChars().count() == 4);
+    ctx.CHECK(optional.getAnalysis().getFirstChars().contains('y'));
+    ctx.CHECK(!optional.getAnalysis().getFirstChars().contains('c'));
+
+    Regex bounded("a?b?c?");
+    ctx.CHECK(bounded.getAnalysis().getMinLength() == 0);
+    ctx.CHECK(bounded.getAnalysis().getMaxLength() == 3);
+    ctx.CHECK(bounded.getAnalysis().getFirstChars().count() == 3);
+
+    ctx.result();
+
+    ctx.DESC("find() skips impossible start indexes");
+
+    Regex regex("[xy]z+");
+    for (Engine engine : {Engine::BACKTRACK, Engine::PIKE_VM, Engine::DFA,
+                          Engine::SHIFT_AND}) {
+        Matcher matcher(regex, engine);
+        Range r = matcher.find(string(5000, 'z') + "yzz" + string(100, 'z'));
+        ctx.CHECK(r.start == 5000 && r.end == 5103);
+        r = matcher.find(string(5000, 'z') + "y");
+        ctx.CHECK(r.start == -1 && r.end == -1);
+    }
+
+    ctx.result();
+
+    ctx.DESC("match() only tries index 0");
+
+    // Checking every start index would take quadratic time here.
+    Regex star("a*b");
+    string as(100000, 'a');
+    for (Engine engine : {Engine::BACKTRACK, Engine::PIKE_VM, Engine::DFA}) {
+        Matcher matcher(star, engine);
+        ctx.CHECK(!matcher.match(as));
+        ctx.CHECK(matcher.match(as + "b"));
+        ctx.CHECK(!matcher.match("b" + as));
+    }
+
+    ctx.result();
+}
+
+
+/*! Test the required-literal prefilter. */
+void test_prefilter(TestContext &ctx) {
+    ctx.DESC("Required literal extraction");
+
+    Regex prefix("abc+d?e");
+    ctx.CHECK(prefix.getPrefilter().getLiteral() == "abc");
+    ctx.CHECK(prefix.getPrefilter().getMinOffset() == 0);
+    ctx.CHECK(prefix.getPrefilter().getMaxOffset() == 0);
+
+    Regex inner("[xy]?.d*hello[^a]");
+    ctx.CHECK(inner.getPrefilter().getLiteral() == "hello");
+    ctx.CHECK(inner.getPrefilter().getMinOffset() == 1);
+    ctx.CHECK(inner.getPrefilter().getMaxOffset() == -1);
+
+    Regex bounded("[xy]?.abx?ab");
+    ctx.CHECK(bounded.getPrefilter().getLiteral() == "ab");
+    ctx.CHECK(bounded.getPrefilter().getMinOffset() == 1);
+    ctx.CHECK(bounded.getPrefilter().getMaxOffset() == 2);
+
+    Regex none("a?.[bc]*");
+    ctx.CHECK(!none.getPrefilter().isActive());
+
+    ctx.result();
+
+    ctx.DESC("Vectorized literal search agrees with string::find");
+
+    mt19937 rng(99);
+    bool agree = true;
+    for (int trial = 0; trial < 500; trial++) {
+        string haystack, needle;
+        int length = rng() % 200;
+        for (int i = 0; i < length; i++)
+            haystack += "abc"[rng() % 3];
+        int needleLength = 1 + rng() % 6;
+        for (int i = 0; i < needleLength; i++)
+            needle += "abc"[rng() % 3];
+
+        const char *begin = haystack.data();
+        const char *p = findLiteral(begin, begin + haystack.length(),
+                                    needle.data(), (int) needle.length());
+        size_t expected = haystack.find(needle);
+        if (expected == string::npos ? p != nullptr : p != begin + expected)
+            agree = false;
+    }
+    ctx.CHECK(agree);
+
+    ctx.result();
+
+    ctx.DESC("Prefiltered find() skips to the literal");
+
+    string haystack = string(10000, 'x') + "yhelloz" + string(100, 'x');
+    for (Engine engine : {Engine::BACKTRACK, Engine::PIKE_VM, Engine::DFA}) {
+        Range r = Matcher(inner, engine).find(haystack);
+        ctx.CHECK(r.start == 9999 && r.end == 10007);
+        r = Matcher(inner, engine).find(string(10000, 'x'));
+        ctx.CHECK(r.start == -1 && r.end == -1);
+    }
+
+    ctx.result();
+}
+
+
+/*! Test the Boyer-Moore-Horspool engine for plain-string regexes. */
+void test_literal(TestContext &ctx) {
+    ctx.DESC("Plain-string regexes use the literal engine");
+
+    ctx.CHECK(Regex("hello").getPreferredEngine() == Engine::LITERAL);
+    ctx.CHECK(Regex("\\[x\\]").getPreferredEngine() == Engine::LITERAL);
+    ctx.CHECK(Regex("hel+o").getPreferredEngine() != Engine::LITERAL);
+    ctx.CHECK(Regex("h.llo").getPreferredEngine() != Engine::LITERAL);
+    ctx.CHECK(Regex("").getPreferredEngine() != Engine::LITERAL);
+
+    ctx.result();
+
+    ctx.DESC("Horspool search agrees with string::find");
+
+    mt19937 rng(2024);
+    bool agree = true;
+    for (int trial = 0; trial < 500; trial++) {
+        string haystack, pattern;
+        int length = rng() % 200;
+        for (int i = 0; i < length; i++)
+            haystack += "abc"[rng() % 3];
+        int patternLength = 1 + rng() % 8;
+        for (int i = 0; i < patternLength; i++)
+            pattern += "abc"[rng() % 3];
+
+        Regex regex(pattern);
+        int start = length == 0 ? 0 : rng() % length;
+        size_t expected = haystack.find(pattern, start);
+        for (Range r : {regex.getLiteralSearcher().find(haystack, start),
+                        regex.getLiteralSearcher().findHorspool(haystack,
+                                                                start)}) {
+            if (expected == string::npos ? r.start != -1 :
+                r.start != (int) expected ||
+                r.end != (int) (expected + pattern.length())) {
+                agree = false;
+            }
+        }
+    }
+    ctx.CHECK(agree);
+
+    ctx.result();
+
+    ctx.DESC("Literal engine agrees with backtracking engine");
+    ctx.CHECK(engineAgreesWithBacktracker(Engine::LITERAL));
+    ctx.result();
+}
+
+
+/*! Test the compile-time regex. */
+void test_static_regex(TestContext &ctx) {
+    // The patterns are parsed by the compiler.
+    static_assert(StaticRegex<STATIC_ABC>::size() == 3, "");
+    static_assert(StaticRegex<STATIC_ESCAPES>::size() == 3, "");
+    static_assert(StaticRegex<STATIC_COMPLEX>::size() == 10, "");
+
+    ctx.DESC("Compile-time regex agrees with backtracking engine");
+
+    ctx.CHECK(staticAgreesWithBacktracker<STATIC_ABC>());
+    ctx.CHECK(staticAgreesWithBacktracker<STATIC_DOT_STAR>());
+    ctx.CHECK(staticAgreesWithBacktracker<STATIC_CLASSES>());
+    ctx.CHECK(staticAgreesWithBacktracker<STATIC_OPTIONAL>());
+    ctx.CHECK(staticAgreesWithBacktracker<STATIC_EXCLUDE>());
+    ctx.CHECK(staticAgreesWithBacktracker<STATIC_ESCAPES>());
+    ctx.CHECK(staticAgreesWithBacktracker<STATIC_COMPLEX>());
+    ctx.CHECK(staticAgreesWithBacktracker<STATIC_INNER_LITERAL>());
+
+    ctx.result();
+
+    ctx.DESC("Compile-time regex makes no allocations");
+
+    string s = "xxabbbcddeeeeeeeegjjjjkxx";
+    string whole = s.substr(2, 21);
+    long before = numAllocations;
+    Range r = StaticRegex<STATIC_COMPLEX>::find(s);
+    bool matched = StaticRegex<STATIC_COMPLEX>::match(whole);
+    ctx.CHECK(numAllocations == before);
+    ctx.CHECK(r.start == 2 && r.end == 23);
+    ctx.CHECK(matched);
+
+    ctx.result();
+
+    ctx.DESC("Compile-time parser rejects what the runtime parser does");
+
+    // Parsed at run time here, since a pattern that throws while being
+    // parsed by the compiler doesn't compile at all.
+    bool sameErrors = true;
+    for (const char *p : {"a\\", "\\", "[ab", "a{3,2}"}) {
+        string staticError, runtimeError;
+        try {
+            countStaticOps(p);
+        } catch (const invalid_argument &e) {
+            staticError = e.what();
+        }
+        try {
+            clearRegex(parseRegex(p));
+        } catch (const invalid_argument &e) {
+            runtimeError = e.what();
+        }
+        if (staticError.empty() || staticError != runtimeError)
+            sameErrors = false;
+    }
+    ctx.CHECK(sameErrors);
+
+    ctx.result();
+}
+
+
+/*! Test the bytecode backtracking engine. */
+void test_bytecode(TestContext &ctx) {
+    ctx.DESC("Bytecode engine agrees with operator backtracking");
+    ctx.CHECK(engineAgreesWithBacktracker(Engine::BACKTRACK));
+    ctx.result();
+
+    ctx.DESC("Memoized states don't change the matches");
+
+    vector<string> subjects = crossCheckSubjects();
+    bool agree = true;
+    for (const string &pattern : CROSS_CHECK_PATTERNS) {
+        Regex regex(pattern);
+        BytecodeVM memoized(regex.getByteProgram());
+        BytecodeVM plain(regex.getByteProgram(), 0);
+
+        for (const string &s : subjects) {
+            for (int i = 0; i <= (int) s.length(); i++) {
+                Range a = memoized.findAtIndex(s, i);
+                Range b = plain.findAtIndex(s, i);
+                if (a.start != b.start || a.end != b.end)
+                    agree = false;
+            }
+            Range a = memoized.find(s), b = plain.find(s);
+            if (a.start != b.start || a.end != b.end)
+                agree = false;
+            if (!memoized.isMemoizing() || plain.isMemoizing())
+                agree = false;
+        }
+    }
+    ctx.CHECK(agree);
+
+    ctx.result();
+
+    // Without memoizing, this takes about 2^n steps to fail.
+    const int n = 40;
+    string pattern;
+    for (int i = 0; i < n; i++)
+        pattern += "a?";
+    pattern += string(n, 'a');
+    Regex regex(pattern);
+
+    ctx.DESC("Memoized backtracking on pathological regex");
+
+    BytecodeVM vm(regex.getByteProgram());
+    Range r = vm.findAtIndex(string(n - 1, 'a'), 0);
+    ctx.CHECK(vm.isMemoizing());
+    ctx.CHECK(r.start == -1 && r.end == -1);
+
+    r = vm.find("b" + string(2 * n, 'a'));
+    ctx.CHECK(r.start == 1 && r.end == 2 * n + 1);
+
+    Matcher matcher(regex, Engine::BACKTRACK);
+    ctx.CHECK(!matcher.match(string(2 * n - 1, 'a') + "b"));
+    ctx.CHECK(matcher.match(string(2 * n, 'a')));
+
+    // Strings too long for the budget fall back to plain backtracking.
+    vm.find(string(BytecodeVM::DEFAULT_MEMO_BUDGET, 'a'));
+    ctx.CHECK(!vm.isMemoizing());
+
+    ctx.result();
+}
+
+
+/*! Test the Pike VM engine. */
+void test_pike_vm(TestContext &ctx) {
+    ctx.DESC("Pike VM agrees with backtracking engine");
+    ctx.CHECK(engineAgreesWithBacktracker(Engine::PIKE_VM));
+    ctx.result();
+
+    // The backtracking engine takes exponential time on this regex, because
+    // it tries every combination of the optional operators before failing.
+    const int n = 30;
+    string pattern;
+    for (int i = 0; i < n; i++)
+        pattern += "a?";
+    pattern += string(n, 'a');
+
+    vector<RegexOperator *> regex = parseRegex(pattern);
+    Range r;
+
+    ctx.DESC("Pike VM on pathological regex");
+
+    r = find(regex, string(n, 'a'), Engine::PIKE_VM);
+    ctx.CHECK(r.start == 0 && r.end == n);
+
+    r = find(regex, string(n - 1, 'a'), Engine::PIKE_VM);
+    ctx.CHECK(r.start == -1 && r.end == -1);
+
+    r = find(regex, "b" + string(2 * n, 'a'), Engine::PIKE_VM);
+    ctx.CHECK(r.start == 1 && r.end == 2 * n + 1);
+
+    ctx.CHECK(match(regex, string(2 * n, 'a')));
+    ctx.CHECK(!match(regex, string(2 * n + 1, 'a')));
+
+    ctx.result();
+
+    clearRegex(regex);
+}
+
+
+/*! Test the lazy DFA engine. */
+void test_lazy_dfa(TestContext &ctx) {
+    ctx.DESC("Lazy DFA agrees with backtracking engine");
+    ctx.CHECK(engineAgreesWithBacktracker(Engine::DFA));
+    ctx.result();
+
+    vector<RegexOperator *> regex = parseRegex("ab+c?d*[ef]+g[^ghi]*j.+k");
+    string haystack = "ab" + string(1000, 'z');
+    for (int i = 0; i < 200; i++)
+        haystack += "abbbcddfgxyzzy";
+    haystack += "abegjkk";
+
+    ctx.DESC("Lazy DFA caches states");
+
+    Regex compiled(regex);
+    static_assert(!is_constructible<Regex, vector<RegexOperator *>>::value,
+                  "a Regex mustn't keep a temporary vector");
+    Matcher dfa(compiled, Engine::DFA);
+    Range r = dfa.find(haystack);
+    ctx.CHECK(r.start == (int) haystack.length() - 7);
+    ctx.CHECK(r.end == (int) haystack.length());
+
+    DFAStats stats = dfa.getDFAStats();
+    ctx.CHECK(stats.cacheMisses > 0);
+    ctx.CHECK(stats.cacheHits > 10 * stats.cacheMisses);
+    ctx.CHECK(stats.cacheFlushes == 0);
+    ctx.CHECK(stats.bailouts == 0);
+
+    ctx.result();
+
+    ctx.DESC("Lazy DFA flushes its cache when over budget");
+
+    // Big enough for a handful of states, but no more.  The long run of 'z'
+    // characters (after the "ab" that makes the prefilter start the DFA at
+    // the very beginning) lets the DFA make enough progress that it keeps
+    // going.
+    Matcher smallDfa(compiled, Engine::DFA, 2048);
+    r = smallDfa.find(haystack);
+    ctx.CHECK(r.start == (int) haystack.length() - 7);
+    ctx.CHECK(r.end == (int) haystack.length());
+    ctx.CHECK(smallDfa.getDFAStats().cacheFlushes > 0);
+
+    ctx.result();
+
+    ctx.DESC("Lazy DFA falls back to Pike VM when thrashing");
+
+    // Too small to hold even the start states, so the DFA must give up.
+    Matcher tinyDfa(compiled, Engine::DFA, 1);
+    r = tinyDfa.find(haystack);
+    ctx.CHECK(r.start == (int) haystack.length() - 7);
+    ctx.CHECK(r.end == (int) haystack.length());
+    ctx.CHECK(tinyDfa.match("abegjkk"));
+    ctx.CHECK(!tinyDfa.match("abegjkkz"));
+    ctx.CHECK(tinyDfa.getDFAStats().bailouts > 0);
+
+    ctx.result();
+
+    clearRegex(regex);
+}
+
+
+/*! Test sharing one compiled regex between many threads. */
+void test_shared_regex(TestContext &ctx) {
+    const Regex regex("ab+c?d*[ef]+g[^ghi]*j.+k");
+    const Engine engines[] = {Engine::BACKTRACK, Engine::PIKE_VM, Engine::DFA,
+                              Engine::SHIFT_AND};
+
+    vector<string> subjects = crossCheckSubjects();
+    subjects.push_back("aaabbbbbbbbegjkk");
+    subjects.push_back("abegjkkmmmm");
+
+    // Work out the expected answers on this thread first.
+    vector<Range> expected;
+    Matcher reference(regex, Engine::BACKTRACK);
+    for (const string &s : subjects)
+        expected.push_back(reference.find(s));
+
+    ctx.DESC("Compiled regex shared by many threads");
+
+    atomic<int> mismatches(0);
+    vector<thread> threads;
+    const int numEngines = sizeof engines / sizeof engines[0];
+    ctx.CHECK(regex.getShiftAndSearcher().isActive());
+
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([&, t]() {
+            Matcher matcher(regex, engines[t % numEngines]);
+            for (int iter = 0; iter < 20; iter++) {
+                for (size_t i = 0; i < subjects.size(); i++) {
+                    Range r = matcher.find(subjects[i]);
+                    if (r.start != expected[i].start ||
+                        r.end != expected[i].end) {
+                        mismatches++;
+                    }
+                }
+            }
+        });
+    }
+    for (thread &t : threads)
+        t.join();
+
+    ctx.CHECK(mismatches == 0);
+    ctx.result();
+
+    ctx.DESC("Free find() and match() pick the Matcher's engine");
+
+    // They resolve engines the same way a Regex does, without compiling
+    // one.
+    bool sameEngine = true;
+    for (const string &pattern : CROSS_CHECK_PATTERNS) {
+        vector<RegexOperator *> ops = parseRegex(pattern);
+        Engine preferred = Regex(pattern).getPreferredEngine();
+        if (resolveEngine(ops, Engine::AUTO) != preferred ||
+            resolveEngine(ops, Engine::PIKE_VM) != Engine::PIKE_VM)
+            sameEngine = false;
+        clearRegex(ops);
+    }
+    ctx.CHECK(sameEngine);
+
+    ctx.result();
+}
+
+
+/*! Test the cache of compiled regexes. */
+void test_regex_cache(TestContext &ctx) {
+    ctx.DESC("Cache hits, misses and LRU eviction");
+
+    RegexCache cache(2, 1);
+    RegexCache::Handle abc = cache.get("ab+c");
+    ctx.CHECK(cache.get("ab+c") == abc);
+    ctx.CHECK(cache.getStats().hits == 1 && cache.getStats().misses == 1);
+
+    RegexCache::Handle xyz = cache.get("x.z");
+    cache.get("ab+c");
+
+    // The cache is full, so this evicts the least recently used pattern.
+    RegexCache::Handle q = cache.get("q*");
+    ctx.CHECK(cache.size() == 2);
+    ctx.CHECK(cache.getStats().evictions == 1);
+    ctx.CHECK(cache.get("ab+c") == abc);
+    ctx.CHECK(cache.get("x.z") != xyz);
+    ctx.CHECK(cache.getStats().hits == 3 && cache.getStats().misses == 4);
+
+    // Evicted handles still work.
+    Matcher matcher(*xyz);
+    Range r = matcher.find("wxyz");
+    ctx.CHECK(r.start == 1 && r.end == 4);
+
+    cache.clear();
+    ctx.CHECK(cache.size() == 0);
+    r = Matcher(*abc).find("abbbc");
+    ctx.CHECK(r.start == 0 && r.end == 5);
+
+    ctx.result();
+
+    ctx.DESC("Cache shared by many threads");
+
+    RegexCache shared(8);
+    atomic<int> mismatches(0);
+    vector<thread> threads;
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([&, t]() {
+            for (int iter = 0; iter < 200; iter++) {
+                // Twice as many patterns as fit, to keep evicting them.
+                const string &pattern =
+                    CROSS_CHECK_PATTERNS[(t + iter) % 16];
+                RegexCache::Handle regex = shared.get(pattern);
+                if (regex->getOperators().size() !=
+                    Regex(pattern).getOperators().size()) {
+                    mismatches++;
+                }
+                Matcher(*regex).find("abcdefgijk");
+            }
+        });
+    }
+    for (thread &t : threads)
+        t.join();
+
+    RegexCacheStats stats = shared.getStats();
+    ctx.CHECK(mismatches == 0);
+    ctx.CHECK(stats.hits + stats.misses == 1600);
+    ctx.CHECK(shared.size() <= 8);
+
+    ctx.result();
+}
+
+
+/*! Test iterating over every match in a string. */
+void test_find_all(TestContext &ctx) {
+    ctx.DESC("findAll() on simple patterns");
+
+    for (Engine engine : {Engine::BACKTRACK, Engine::PIKE_VM, Engine::DFA,
+                          Engine::SHIFT_AND}) {
+        Regex pairs("a?a?");
+        Matcher matcher(pairs, engine);
+        vector<Range> found;
+        for (const Range &r : matcher.findAll("aaaxa"))
+            found.push_back(r);
+
+        // The DFA must not let a match reach back into the previous one.
+        ctx.CHECK(found.size() == 3);
+        ctx.CHECK(found[0].start == 0 && found[0].end == 2);
+        ctx.CHECK(found[1].start == 2 && found[1].end == 3);
+        ctx.CHECK(found[2].start == 4 && found[2].end == 5);
+
+        Regex none("q+");
+        Matcher noMatches(none, engine);
+        MatchRange all = noMatches.findAll("aaaxa");
+        ctx.CHECK(all.begin() == all.end());
+    }
+
+    ctx.result();
+
+    ctx.DESC("findAll() agrees with find() on the rest of the string");
+
+    // The reference answer comes from searching copies of the tail.
+    vector<string> subjects = crossCheckSubjects();
+    BacktrackContext context;
+    bool agree = true;
+    for (const string &pattern : CROSS_CHECK_PATTERNS) {
+        Regex regex(pattern);
+        for (const string &s : subjects) {
+            vector<Range> expected;
+            int offset = 0;
+            for (;;) {
+                Range r = findBacktrack(regex.getOperators(),
+                                        s.substr(offset), context);
+                if (r.start == -1)
+                    break;
+                expected.push_back(Range(r.start + offset, r.end + offset));
+                offset += r.end;
+            }
+
+            for (Engine engine : {Engine::BACKTRACK, Engine::PIKE_VM,
+                                  Engine::DFA, Engine::LITERAL,
+                                  Engine::SHIFT_AND}) {
+                Matcher matcher(regex, engine);
+                size_t i = 0;
+                for (const Range &r : matcher.findAll(s)) {
+                    if (i >= expected.size() ||
+                        r.start != expected[i].start ||
+                        r.end != expected[i].end) {
+                        agree = false;
+                        break;
+                    }
+                    i++;
+                }
+                if (i != expected.size())
+                    agree = false;
+            }
+        }
+    }
+    ctx.CHECK(agree);
+
+    ctx.result();
+}
+
+
+/*! Test finding matches in input that arrives in chunks. */
+void test_stream(TestContext &ctx) {
+    ctx.DESC("StreamMatcher on matches that span chunks");
+
+    Regex abc("abc+");
+    vector<StreamMatch> found;
+    StreamMatcher stream(abc, [&](const StreamMatch &m) {
+        found.push_back(m);
+    });
+    for (const char *chunk : {"xxa", "b", "", "cc", "cxab", "cab", "c"})
+        stream.feed(chunk);
+
+    // The last match can't be reported until the stream ends, since more
+    // c's could follow.
+    ctx.CHECK(found.size() == 2);
+    ctx.CHECK(found[0].start == 2 && found[0].end == 7);
+    ctx.CHECK(found[1].start == 8 && found[1].end == 11);
+    stream.finish();
+    ctx.CHECK(found.size() == 3);
+    ctx.CHECK(found[2].start == 11 && found[2].end == 14);
+
+    // The matcher starts over at offset 0 after finish().
+    found.clear();
+    stream.feed("ab");
+    stream.feed("c");
+    stream.finish();
+    ctx.CHECK(found.size() == 1);
+    ctx.CHECK(found[0].start == 0 && found[0].end == 3);
+
+    ctx.result();
+
+    ctx.DESC("StreamMatcher agrees with findAll() on any chunking");
+
+    vector<string> subjects = crossCheckSubjects();
+    mt19937 rng(777);
+    bool agree = true;
+    for (const string &pattern : CROSS_CHECK_PATTERNS) {
+        Regex regex(pattern);
+        Matcher matcher(regex);
+        vector<StreamMatch> streamed;
+        StreamMatcher stream(regex, [&](const StreamMatch &m) {
+            streamed.push_back(m);
+        });
+
+        for (const string &s : subjects) {
+            vector<Range> expected;
+            for (const Range &r : matcher.findAll(s))
+                expected.push_back(r);
+
+            streamed.clear();
+            for (size_t i = 0; i < s.length(); ) {
+                size_t length = min<size_t>(rng() % 5, s.length() - i);
+                stream.feed(s.data() + i, length);
+                i += length;
+            }
+            stream.finish();
+
+            if (streamed.size() != expected.size()) {
+                agree = false;
+                continue;
+            }
+            for (size_t i = 0; i < expected.size(); i++) {
+                if (streamed[i].start != expected[i].start ||
+                    streamed[i].end != expected[i].end)
+                    agree = false;
+            }
+        }
+    }
+    ctx.CHECK(agree);
+
+    ctx.result();
+
+    ctx.DESC("StreamMatcher keeps only a bounded tail");
+
+    // A pattern with a bounded match length keeps no more than that, however
+    // much input goes by.
+    Regex bounded("a?b?cd+e?");
+    long count = 0;
+    size_t maxBuffered = 0;
+    StreamMatcher boundedStream(bounded, [&](const StreamMatch &) {
+        count++;
+    });
+    string chunk;
+    for (int i = 0; i < 1000; i++)
+        chunk += i % 7 == 0 ? "abcdd" : "xyz";
+    for (int i = 0; i < 1000; i++) {
+        boundedStream.feed(chunk);
+        maxBuffered = max(maxBuffered, boundedStream.getBufferedBytes());
+    }
+    ctx.CHECK(boundedStream.getPosition() == 1000 * (int64_t) chunk.length());
+    boundedStream.finish();
+    ctx.CHECK(count == 1000 * 143);
+    ctx.CHECK(maxBuffered <= 5);
+
+    // An unbounded match that hasn't ended yet needs nothing kept at all,
+    // since the search resumes at its end.
+    Regex unbounded("x.*");
+    vector<StreamMatch> lines;
+    StreamMatcher unboundedStream(unbounded, [&](const StreamMatch &m) {
+        lines.push_back(m);
+    });
+    for (int i = 0; i < 1000; i++) {
+        unboundedStream.feed(chunk);
+        maxBuffered = max(maxBuffered, unboundedStream.getBufferedBytes());
+    }
+    unboundedStream.finish();
+    ctx.CHECK(lines.size() == 1);
+    ctx.CHECK(lines[0].start == 5);
+    ctx.CHECK(lines[0].end == 1000 * (int64_t) chunk.length());
+    ctx.CHECK(maxBuffered <= 5);
+
+    ctx.result();
+}
+
+
+/*! Test searching text line by line on worker threads. */
+void test_grep(TestContext &ctx) {
+    ctx.DESC("splitLines() keeps lines whole");
+
+    string text = "ab\ncd\n\nlonger line\nx";
+    vector<string_view> chunks = splitLines(text, 4);
+    ctx.CHECK(chunks.size() == 3);
+    ctx.CHECK(chunks[0] == "ab\ncd\n");
+    ctx.CHECK(chunks[1] == "\nlonger line\n");
+    ctx.CHECK(chunks[2] == "x");
+    ctx.CHECK(splitLines("", 4).empty());
+
+    ctx.result();
+
+    ctx.DESC("parallelGrep() agrees with searching each line");
+
+    // Join the subjects into one text, some of them with several lines.
+    vector<string> subjects = crossCheckSubjects();
+    string all;
+    for (size_t i = 0; i < subjects.size(); i++) {
+        all += subjects[i];
+        all += i % 3 == 0 ? "" : "\n";
+    }
+
+    bool agree = true;
+    for (const string &pattern : CROSS_CHECK_PATTERNS) {
+        Regex regex(pattern);
+        Matcher matcher(regex);
+
+        string expected;
+        long expectedCount = 0;
+        for (string_view line : splitLines(all, 1)) {
+            if (!line.empty() && line.back() == '\n')
+                line.remove_suffix(1);
+            if (matcher.find(line).start != -1) {
+                expected += "> " + string(line) + "\n";
+                expectedCount++;
+            }
+        }
+
+        for (int numThreads : {1, 3}) {
+            for (size_t chunkSize : {1, 40, 1 << 20}) {
+                GrepOptions options;
+                options.numThreads = numThreads;
+                options.chunkSize = chunkSize;
+                options.prefix = "> ";
+
+                string output;
+                long count = parallelGrep(regex, all, options,
+                    [&](const string &s) { output += s; });
+                if (output != expected || count != expectedCount)
+                    agree = false;
+
+                options.countOnly = true;
+                output.clear();
+                count = parallelGrep(regex, all, options,
+                    [&](const string &s) { output += s; });
+                if (!output.empty() || count != expectedCount)
+                    agree = false;
+            }
+        }
+    }
+    ctx.CHECK(agree);
+
+    ctx.result();
+}
+
+
+/*! Test searching parts of one buffer on several threads. */
+void test_parallel(TestContext &ctx) {
+    ctx.DESC("parallelFind() and parallelCount() on matches across parts");
+
+    // Matches straddle every part boundary.
+    Regex regex("abc+d?");
+    string s;
+    for (int i = 0; i < 100; i++)
+        s += "xxabccd";
+    for (int partSize : {1, 2, 5, 7, 100}) {
+        LargeRange r = parallelFind(regex, s, 3, partSize);
+        ctx.CHECK(r.start == 2 && r.end == 7);
+        ctx.CHECK(parallelCount(regex, s, 3, partSize) == 100);
+    }
+
+    // The only match is in the last part.
+    string none(1000, 'x');
+    LargeRange r = parallelFind(regex, none + "abc", 4, 10);
+    ctx.CHECK(r.start == 1000 && r.end == 1003);
+    r = parallelFind(regex, none, 4, 10);
+    ctx.CHECK(r.start == -1 && r.end == -1);
+    ctx.CHECK(parallelCount(regex, none, 4, 10) == 0);
+
+    ctx.result();
+
+    ctx.DESC("Parallel search agrees with the serial engine");
+
+    // Join the subjects into one buffer, so that the patterns hit matches
+    // of every length across the part boundaries.
+    string all;
+    for (const string &subject : crossCheckSubjects())
+        all += subject;
+
+    bool agree = true;
+    for (const string &pattern : CROSS_CHECK_PATTERNS) {
+        Regex regex(pattern);
+        Matcher matcher(regex);
+
+        for (size_t offset : {0, 1, 7, 500, 1500}) {
+            string_view rest = string_view(all).substr(offset);
+            Range expected = matcher.find(rest);
+            int64_t expectedCount = 0;
+            for (const Range &m : matcher.findAll(rest)) {
+                (void) m;
+                expectedCount++;
+            }
+
+            for (size_t partSize : {1, 3, 16, 1000}) {
+                LargeRange r = parallelFind(regex, rest, 3, partSize);
+                if (r.start != expected.start || r.end != expected.end)
+                    agree = false;
+                if (parallelCount(regex, rest, 3, partSize) != expectedCount)
+                    agree = false;
+            }
+        }
+    }
+    ctx.CHECK(agree);
+
+    ctx.result();
+}
+
+
+/*! Test matching every string of a column at once. */
+void test_batch(TestContext &ctx) {
+    ctx.DESC("batchMatch() and batchFind() agree with each string");
+
+    // Enough copies of the subjects to fill several blocks, with a partial
+    // block and a partial bitmap word at the end.
+    vector<string> subjects = crossCheckSubjects();
+    string data;
+    vector<int64_t> offsets{0};
+    while (offsets.size() <= 3 * BATCH_BLOCK_SIZE + 37) {
+        data += subjects[offsets.size() % subjects.size()];
+        offsets.push_back((int64_t) data.length());
+    }
+    StringColumn column{data.data(), offsets.data(), offsets.size() - 1};
+
+    bool agree = true;
+    for (const string &pattern : CROSS_CHECK_PATTERNS) {
+        Regex regex(pattern);
+        Matcher matcher(regex);
+
+        for (int numThreads : {1, 3}) {
+            vector<Range> ranges;
+            vector<uint64_t> matched = batchMatch(regex, column, numThreads);
+            vector<uint64_t> found = batchFind(regex, column, numThreads,
+                                               &ranges);
+            if (matched.size() != (column.size + 63) / 64 ||
+                found.size() != matched.size() ||
+                ranges.size() != column.size) {
+                agree = false;
+                continue;
+            }
+
+            for (size_t i = 0; i < column.size; i++) {
+                string_view s = column[i];
+                bool matchBit = (matched[i / 64] >> (i % 64)) & 1;
+                bool findBit = (found[i / 64] >> (i % 64)) & 1;
+                Range r = matcher.find(s);
+
+                if (matchBit != matcher.match(s) ||
+                    findBit != (r.start != -1) ||
+                    ranges[i].start != r.start || ranges[i].end != r.end)
+                    agree = false;
+            }
+        }
+    }
+    ctx.CHECK(agree);
+
+    // No strings at all
+    Regex regex("a");
+    StringColumn empty{"", offsets.data(), 0};
+    ctx.CHECK(batchMatch(regex, empty, 2).empty());
+
+    ctx.result();
+}
+
+
+/*! Test matching many regexes in one pass. */
+void test_regex_set(TestContext &ctx) {
+    ctx.DESC("RegexSet on simple patterns");
+
+    RegexSet set({"abc", "a.*", "b+", "x?", "[^a]c"});
+    SetMatcher matcher(set);
+    ctx.CHECK(set.size() == 5);
+    ctx.CHECK(matcher.match("abc") == vector<int>({0, 1}));
+    ctx.CHECK(matcher.match("bbb") == vector<int>({2}));
+    ctx.CHECK(matcher.match("x") == vector<int>({3}));
+    ctx.CHECK(matcher.match("").empty());
+    ctx.CHECK(matcher.search("xxabc") == vector<int>({0, 1, 2, 3, 4}));
+    ctx.CHECK(matcher.search("qqq").empty());
+
+    // Patterns that only match the empty string are never found.
+    ctx.CHECK(matcher.search("qqqcc") == vector<int>({4}));
+
+    RegexSet none(vector<string>{});
+    SetMatcher noneMatcher(none);
+    ctx.CHECK(noneMatcher.match("abc").empty());
+    ctx.CHECK(noneMatcher.search("abc").empty());
+
+    ctx.result();
+
+    ctx.DESC("RegexSet agrees with each regex on its own");
+
+    vector<vector<RegexOperator *>> operators;
+    for (const string &pattern : CROSS_CHECK_PATTERNS)
+        operators.push_back(parseRegex(pattern));
+
+    RegexSet fromPatterns(CROSS_CHECK_PATTERNS);
+    RegexSet fromOperators(operators);
+    SetMatcher patternMatcher(fromPatterns);
+    SetMatcher operatorMatcher(fromOperators);
+
+    // Budgets too small for more than a few states make the DFA give up at
+    // the start, or partway through.
+    SetMatcher fallbackMatcher(fromPatterns, 1);
+    SetMatcher partialMatcher(fromPatterns, 5000);
+
+    vector<unique_ptr<Matcher>> each;
+    for (int k = 0; k < fromPatterns.size(); k++)
+        each.push_back(make_unique<Matcher>(fromPatterns.getRegex(k)));
+
+    bool agree = true;
+    for (const string &s : crossCheckSubjects()) {
+        vector<int> expectedMatch, expectedSearch;
+        for (int k = 0; k < (int) each.size(); k++) {
+            if (each[k]->match(s))
+                expectedMatch.push_back(k);
+            if (each[k]->find(s).start != -1)
+                expectedSearch.push_back(k);
+        }
+
+        for (SetMatcher *m : {&patternMatcher, &operatorMatcher,
+                              &fallbackMatcher, &partialMatcher}) {
+            if (m->match(s) != expectedMatch || m->search(s) != expectedSearch)
+                agree = false;
+        }
+    }
+    ctx.CHECK(agree);
+    ctx.CHECK(partialMatcher.getDFAStats().bailouts > 0);
+
+    for (vector<RegexOperator *> &ops : operators)
+        clearRegex(ops);
+
+    ctx.result();
+}
+/*! Test scanning for many literals at once, and finding many regexes. */
+void test_teddy(TestContext &ctx) {
+    ctx.DESC("TeddyScanner agrees with a naive search");
+
+    vector<TeddyScanner::Kernel> kernels{TeddyScanner::SCALAR};
+    if (TeddyScanner::bestKernel() != TeddyScanner::SCALAR)
+        kernels.push_back(TeddyScanner::SSSE3);
+    if (TeddyScanner::bestKernel() == TeddyScanner::AVX2)
+        kernels.push_back(TeddyScanner::AVX2);
+
+    // A small alphabet, so that the literals overlap and share nibbles, and
+    // strings long enough to cross several vector blocks
+    mt19937 rng(2024);
+    const string alphabet = "abcqrs\x81\xf1";
+    auto randomString = [&](int length) {
+        string s;
+        for (int i = 0; i < length; i++)
+            s += alphabet[rng() % alphabet.length()];
+        return s;
+    };
+
+    bool agree = true;
+    for (int round = 0; round < 60; round++) {
+        vector<string> literals;
+        int count = 1 + rng() % (round < 30 ? 8 : 64);
+        for (int i = 0; i < count; i++)
+            literals.push_back(randomString(1 + rng() % 5));
+        string s = randomString(rng() % 200);
+
+        for (TeddyScanner::Kernel kernel : kernels) {
+            TeddyScanner scanner(literals, kernel);
+            int from = 0;
+            while (true) {
+                // The first position from here with a literal, naively
+                int expected = -1;
+                uint64_t expectedFound = 0;
+                for (int p = from; p < (int) s.length() && expected == -1;
+                     p++) {
+                    for (int i = 0; i < count; i++) {
+                        if (s.compare(p, literals[i].length(),
+                                      literals[i]) == 0)
+                            expectedFound |= (uint64_t) 1 << i;
+                    }
+                    if (expectedFound != 0)
+                        expected = p;
+                }
+
+                uint64_t found = 0;
+                int p = scanner.next(s, from, found);
+                if (p != expected || (p != -1 && found != expectedFound)) {
+                    agree = false;
+                    break;
+                }
+                if (p == -1)
+                    break;
+                from = p + 1;
+            }
+        }
+    }
+    ctx.CHECK(agree);
+
+    uint64_t found;
+    TeddyScanner scanner({"ab", "b"});
+    ctx.CHECK(scanner.size() == 2);
+    ctx.CHECK(scanner.next("xxab", 0, found) == 2 && found == 1);
+    ctx.CHECK(scanner.next("xxab", 3, found) == 3 && found == 2);
+    ctx.CHECK(scanner.next("xxab", 4, found) == -1);
+    ctx.CHECK(scanner.next("xxab", 9, found) == -1);
+    ctx.CHECK(scanner.next("", 0, found) == -1);
+
+    bool threw = false;
+    try {
+        TeddyScanner({});
+    } catch (const invalid_argument &) {
+        threw = true;
+    }
+    ctx.CHECK(threw);
+
+    threw = false;
+    try {
+        TeddyScanner({"a", ""});
+    } catch (const invalid_argument &) {
+        threw = true;
+    }
+    ctx.CHECK(threw);
+
+    threw = false;
+    try {
+        TeddyScanner(vector<string>(65, "a"));
+    } catch (const invalid_argument &) {
+        threw = true;
+    }
+    ctx.CHECK(threw);
+
+    ctx.result();
+
+    ctx.DESC("literalPrefix()");
+
+    auto prefixOf = [](const string &pattern) {
+        vector<RegexOperator *> ops = parseRegex(pattern);
+        string prefix = literalPrefix(ops);
+        clearRegex(ops);
+        return prefix;
+    };
+    ctx.CHECK(prefixOf("abc") == "abc");
+    ctx.CHECK(prefixOf("ab+c") == "ab");
+    ctx.CHECK(prefixOf("ab?c") == "a");
+    ctx.CHECK(prefixOf("a.c") == "a");
+    ctx.CHECK(prefixOf("\\.a[bc]") == ".a");
+    ctx.CHECK(prefixOf(".*ab") == "");
+    ctx.CHECK(prefixOf("[ab]c") == "");
+
+    ctx.result();
+
+    ctx.DESC("MultiFinder agrees with each regex on its own");
+
+    // Every cross-check pattern, more with shared or overlapping prefixes,
+    // and enough of them that some don't fit in the scanner
+    vector<string> patterns = CROSS_CHECK_PATTERNS;
+    for (const char *p : {"ab", "abc+", "ca*d", "cab?", "b.a", "\\[a"})
+        patterns.push_back(p);
+    while (patterns.size() < 80)
+        patterns.push_back(alphabet.substr(0, 3) + "a" +
+                           to_string(patterns.size()));
+
+    vector<unique_ptr<Regex>> regexes;
+    vector<const Regex *> pointers;
+    vector<unique_ptr<Matcher>> each;
+    for (const string &pattern : patterns) {
+        regexes.push_back(make_unique<Regex>(pattern));
+        pointers.push_back(regexes.back().get());
+        each.push_back(make_unique<Matcher>(*regexes.back()));
+    }
+    MultiFinder finder(pointers);
+
+    agree = true;
+    for (const string &s : crossCheckSubjects()) {
+        vector<Range> ranges = finder.find(s);
+        for (size_t k = 0; k < patterns.size(); k++) {
+            Range r = each[k]->find(s);
+            if (ranges[k].start != r.start || ranges[k].end != r.end)
+                agree = false;
+        }
+    }
+    ctx.CHECK(agree);
+
+    MultiFinder none({});
+    ctx.CHECK(none.find("abc").empty());
+
+    ctx.result();
+}
+
+
+/*! Test the bit-parallel Shift-And engine. */
+void test_shift_and(TestContext &ctx) {
+    ctx.DESC("Short patterns with repeats use the Shift-And engine");
+
+    ctx.CHECK(Regex("ab+c").getPreferredEngine() == Engine::SHIFT_AND);
+    ctx.CHECK(Regex("[^ ]*=[0-9]+").getPreferredEngine() ==
+              Engine::SHIFT_AND);
+    ctx.CHECK(Regex("a.c").getPreferredEngine() == Engine::BACKTRACK);
+    ctx.CHECK(Regex("abc").getPreferredEngine() == Engine::LITERAL);
+
+    // One operator too many for a machine word
+    string tooLong = string(64, 'a') + "b*";
+    ctx.CHECK(Regex(tooLong).getPreferredEngine() == Engine::DFA);
+    ctx.CHECK(!Regex(tooLong).getShiftAndSearcher().isActive());
+    ctx.CHECK(!Regex("").getShiftAndSearcher().isActive());
+
+    // The free find() and match() tell whether the engine applies without
+    // building its tables.
+    vector<RegexOperator *> ops = parseRegex("ab+c");
+    ctx.CHECK(ShiftAndSearcher::canSearch(ops));
+    ctx.CHECK(resolveEngine(ops, Engine::LITERAL) == Engine::SHIFT_AND);
+    clearRegex(ops);
+    ops = parseRegex(tooLong);
+    ctx.CHECK(!ShiftAndSearcher::canSearch(ops));
+    clearRegex(ops);
+
+    ctx.result();
+
+    ctx.DESC("Shift-And engine agrees with backtracking engine");
+
+    ctx.CHECK(engineAgreesWithBacktracker(Engine::SHIFT_AND));
+
+    // Random patterns of up to 64 operators, where long runs of optional
+    // operators carry states across most of the word.  The bytecode engine
+    // remembers the states it has failed from, so it stays fast on them.
+    mt19937 rng(64);
+    const string atoms[] = {"a", "b", ".", "[ab]", "[^a]", "[bc]"};
+    const string repeats[] = {"", "?", "*", "+", "?", "?"};
+    bool agree = true;
+    for (int trial = 0; trial < 300; trial++) {
+        string pattern;
+        int numOperators = 1 + rng() % (trial < 200 ? 8 : 64);
+        for (int i = 0; i < numOperators; i++)
+            pattern += atoms[rng() % 6] + repeats[rng() % 6];
+
+        Regex regex(pattern);
+        const ShiftAndSearcher &searcher = regex.getShiftAndSearcher();
+        Matcher backtrack(regex, Engine::BACKTRACK);
+
+        for (int k = 0; k < 10; k++) {
+            string s;
+            int length = rng() % 80;
+            for (int i = 0; i < length; i++)
+                s += "abc"[rng() % 3];
+
+            Range expected = backtrack.find(s);
+            Range actual = searcher.find(s);
+            if (expected.start != actual.start || expected.end != actual.end)
+                agree = false;
+            if (backtrack.match(s) != searcher.match(s))
+                agree = false;
+
+            for (int i = 0; i <= length; i++) {
+                expected = backtrack.findAtIndex(s, i);
+                actual = searcher.findAtIndex(s, i);
+                if (expected.start != actual.start ||
+                    expected.end != actual.end)
+                    agree = false;
+            }
+        }
+    }
+    ctx.CHECK(agree);
+
+    ctx.result();
+
+    ctx.DESC("Shift-And engine uses all 64 bits");
+
+    // The last operator is in the top bit, and a run of optional operators
+    // carries out of the word.
+    Regex full(string(62, 'a') + "b?c*");
+    Matcher matcher(full, Engine::SHIFT_AND);
+    string a62(62, 'a');
+    Range r = matcher.find("xx" + a62 + "bccd");
+    ctx.CHECK(r.start == 2 && r.end == 67);
+    r = matcher.find("x" + a62);
+    ctx.CHECK(r.start == 1 && r.end == 63);
+    ctx.CHECK(matcher.match(a62 + "cc"));
+    ctx.CHECK(!matcher.match(a62 + "cb"));
+
+    string allOptional;
+    for (int i = 0; i < 64; i++)
+        allOptional += "a?";
+    Regex optional(allOptional);
+    ctx.CHECK(optional.getPreferredEngine() == Engine::SHIFT_AND);
+    r = Matcher(optional).find("bb" + string(70, 'a'));
+    ctx.CHECK(r.start == 2 && r.end == 66);
+
+    ctx.result();
+}
+
+
+/* Returns the fewest insertions, deletions and substitutions that turn the
+ * text into a string the regex matches, by relaxing the cost of reaching
+ * each state of the regex after each prefix of the text until nothing
+ * changes.  State 0 is before any operator, and state i + 1 is after
+ * operator i.
+ */
+static int naiveEditDistance(const vector<RegexOperator *> &regex,
+                             string_view text) {
+    int n = (int) regex.size();
+    auto optional = [&](int from, int to) {
+        for (int i = from; i < to; i++) {
+            if (regex[i]->getMinRepeat() != 0)
+                return false;
+        }
+        return true;
+    };
+
+    // Whether operator j can consume the character after state q
+    auto canFollow = [&](int q, int j) {
+        if (q == j + 1)
+            return regex[j]->getMaxRepeat() != 1;
+        return j >= q && optional(q, j);
+    };
+
+    const int INFINITE = 1 << 20;
+    vector<int> cost(n + 1, INFINITE);
+    cost[0] = 0;
+    for (size_t i = 0; ; i++) {
+        // Deleting operators
+        for (bool changed = true; changed; ) {
+            changed = false;
+            for (int q = 0; q <= n; q++) {
+                for (int j = 0; j < n; j++) {
+                    if (canFollow(q, j) && cost[q] + 1 < cost[j + 1]) {
+                        cost[j + 1] = cost[q] + 1;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        if (i == text.length())
+            break;
+
+        // Matching, substituting or inserting the next character
+        vector<int> next(n + 1, INFINITE);
+        for (int q = 0; q <= n; q++) {
+            next[q] = min(next[q], cost[q] + 1);
+            for (int j = 0; j < n; j++) {
+                if (!canFollow(q, j))
+                    continue;
+                bool accepts = regex[j]->getMatchingChars().contains(
+                    (unsigned char) text[i]);
+                next[j + 1] = min(next[j + 1], cost[q] + (accepts ? 0 : 1));
+            }
+        }
+        cost = next;
+    }
+
+    int best = INFINITE;
+    for (int q = 0; q <= n; q++) {
+        if (optional(q, n))
+            best = min(best, cost[q]);
+    }
+    return best;
+}
+
+
+/*! Test approximate matching. */
+void test_approx(TestContext &ctx) {
+    ctx.DESC("findApprox() on simple patterns");
+
+    Regex word("color");
+    ApproxMatch m = findApprox(word, "the colour red", 1);
+    ctx.CHECK(m.start == 4 && m.end == 10 && m.errors == 1);
+    m = findApprox(word, "the colour red", 0);
+    ctx.CHECK(m.start == -1 && m.end == -1 && m.errors == -1);
+    m = findApprox(word, "a color", 2);
+    ctx.CHECK(m.start == 2 && m.end == 7 && m.errors == 0);
+    m = findApprox(word, "a colr b", 1);
+    ctx.CHECK(m.start == 2 && m.end == 6 && m.errors == 1);
+    m = findApprox(word, "a coolor b", 1);
+    ctx.CHECK(m.start == 2 && m.end == 8 && m.errors == 1);
+
+    Regex identifier("get_?[uU]ser[^ ]*");
+    m = findApprox(identifier, "x = getUsr(id)", 1);
+    ctx.CHECK(m.start == 4 && m.end == 14 && m.errors == 1);
+
+    m = findApprox(word, "", 3);
+    ctx.CHECK(m.start == -1);
+
+    ApproxSearcher searcher(word.getOperators());
+    m = searcher.find("colr colour", 1);
+    ctx.CHECK(m.start == 0 && m.end == 4 && m.errors == 1);
+    m = searcher.find("colr colour", 1, 1);
+    ctx.CHECK(m.start == 5 && m.end == 11 && m.errors == 1);
+
+    bool threw = false;
+    try {
+        findApprox(word, "color", -1);
+    } catch (const invalid_argument &) {
+        threw = true;
+    }
+    ctx.CHECK(threw);
+
+    threw = false;
+    try {
+        ApproxSearcher searcher(Regex(string(64, 'a')).getOperators());
+    } catch (const invalid_argument &) {
+        threw = true;
+    }
+    ctx.CHECK(threw);
+
+    ctx.result();
+
+    ctx.DESC("findApprox() agrees with a naive edit distance");
+
+    mt19937 rng(1024);
+    const string atoms[] = {"a", "b", "c", ".", "[ab]", "[^a]"};
+    const string repeats[] = {"", "", "?", "*", "+"};
+    bool agree = true;
+    for (int trial = 0; trial < 400; trial++) {
+        string pattern;
+        int numOperators = 1 + rng() % 5;
+        for (int i = 0; i < numOperators; i++)
+            pattern += atoms[rng() % 6] + repeats[rng() % 5];
+        string s;
+        int length = rng() % 12;
+        for (int i = 0; i < length; i++)
+            s += "abcd"[rng() % 4];
+        int maxErrors = rng() % 6;
+
+        Regex regex(pattern);
+        const vector<RegexOperator *> &ops = regex.getOperators();
+
+        // distance[b][e] for the text [b, e)
+        vector<vector<int>> distance(length + 1, vector<int>(length + 1));
+        for (int b = 0; b < length; b++) {
+            for (int e = b + 1; e <= length; e++) {
+                distance[b][e] = naiveEditDistance(
+                    ops, string_view(s).substr(b, e - b));
+            }
+        }
+        auto fewest = [&](int e) {
+            int best = 1 << 20;
+            for (int b = 0; b < e; b++)
+                best = min(best, distance[b][e]);
+            return best;
+        };
+
+        ApproxMatch expected{-1, -1, -1};
+        for (int e = 1; e <= length; e++) {
+            if (fewest(e) <= maxErrors) {
+                expected.end = e;
+                expected.errors = fewest(e);
+                break;
+            }
+        }
+        if (expected.end != -1) {
+            while (expected.end < length &&
+                   fewest(expected.end + 1) <= expected.errors) {
+                expected.end++;
+                expected.errors = fewest(expected.end);
+            }
+            expected.start = expected.end - 1;
+            for (int b = expected.end - 1; b >= 0; b--) {
+                if (distance[b][expected.end] <= expected.errors)
+                    expected.start = b;
+            }
+        }
+
+        ApproxMatch actual = findApprox(regex, s, maxErrors);
+        if (actual.start != expected.start || actual.end != expected.end ||
+            actual.errors != expected.errors)
+            agree = false;
+    }
+    ctx.CHECK(agree);
+
+    ctx.result();
+}
+
+
+/* Returns where each way of matching the syntax tree from index pos ends, in
+ * the order the regex prefers them, by trying every alternative and every
+ * number of repetitions.  It's exponential, but the tests keep it small.
+ */
+static vector<int> syntaxEnds(const SyntaxNode &node, const string &s,
+                              int pos);
+
+static void repeatEnds(const SyntaxNode &node, const string &s, int pos,
+                       int count, vector<int> &ends) {
+    if (node.maxRepeat == -1 || count < node.maxRepeat) {
+        for (int end : syntaxEnds(*node.children[0], s, pos))
+            repeatEnds(node, s, end, count + 1, ends);
+    }
+    if (count >= node.minRepeat)
+        ends.push_back(pos);
+}
+
+static void concatEnds(const SyntaxNode &node, size_t k, const string &s,
+                       int pos, vector<int> &ends) {
+    if (k == node.children.size()) {
+        ends.push_back(pos);
+        return;
+    }
+    for (int end : syntaxEnds(*node.children[k], s, pos))
+        concatEnds(node, k + 1, s, end, ends);
+}
+
+static vector<int> syntaxEnds(const SyntaxNode &node, const string &s,
+                              int pos) {
+    vector<int> ends;
+    switch (node.kind) {
+    case SyntaxNode::CHARS:
+        if (pos < (int) s.length() &&
+            node.chars.contains((unsigned char) s[pos]))
+            ends.push_back(pos + 1);
+        break;
+
+    case SyntaxNode::CONCAT:
+        concatEnds(node, 0, s, pos, ends);
+        break;
+
+    case SyntaxNode::ALTERNATE:
+        for (const unique_ptr<SyntaxNode> &child : node.children) {
+            vector<int> more = syntaxEnds(*child, s, pos);
+            ends.insert(ends.end(), more.begin(), more.end());
+        }
+        break;
+
+    case SyntaxNode::REPEAT:
+        repeatEnds(node, s, pos, 0, ends);
+        break;
+    }
+    return ends;
+}
+
+
+/* A random pattern with nested groups, alternation and repeat counts, over
+ * the same alphabet as the cross-check subjects.  The bodies of repeats
+ * never match the empty string, since the order in which the regex prefers
+ * empty iterations isn't something syntaxEnds() models.
+ */
+static string randomGroupPattern(mt19937 &rng, int depth) {
+    string pattern;
+    int numAtoms = 1 + rng() % 3;
+    for (int k = 0; k < numAtoms; k++) {
+        int kind = rng() % 10;
+        if (kind < 2 && depth < 2) {
+            pattern += "(";
+            int numAlternatives = 1 + rng() % 3;
+            for (int a = 0; a < numAlternatives; a++) {
+                if (a > 0)
+                    pattern += "|";
+                pattern += randomGroupPattern(rng, depth + 1);
+            }
+            pattern += ")";
+        }
+        else if (kind < 4) {
+            pattern += "[ab]";
+        }
+        else if (kind < 5) {
+            pattern += ".";
+        }
+        else {
+            pattern += "abc"[rng() % 3];
+        }
+
+        int low = rng() % 3, high = low + rng() % 3;
+        switch (rng() % 10) {
+        case 0: pattern += "?"; break;
+        case 1: pattern += "*"; break;
+        case 2: pattern += "+"; break;
+        case 3: pattern += "{" + to_string(low) + "}"; break;
+        case 4: pattern += "{" + to_string(low) + ",}"; break;
+        case 5:
+            pattern += "{" + to_string(low) + "," + to_string(high) + "}";
+            break;
+        default: break;
+        }
+    }
+    return pattern;
+}
+
+static bool hasEmptyRepeat(const SyntaxNode &node) {
+    if (node.kind == SyntaxNode::REPEAT &&
+        PatternAnalysis(*node.children[0]).getMinLength() == 0)
+        return true;
+    for (const unique_ptr<SyntaxNode> &child : node.children) {
+        if (hasEmptyRepeat(*child))
+            return true;
+    }
+    return false;
+}
+
+
+/*! Test groups, alternation and counted repetition. */
+void test_extended_syntax(TestContext &ctx) {
+    ctx.DESC("Parsing repeat counts, groups and alternation");
+
+    vector<RegexOperator *> ops = parseRegex("a{2,5}b{3}c{1,}d{0}");
+    ctx.CHECK(ops.size() == 4);
+    ctx.CHECK(ops[0]->getMinRepeat() == 2 && ops[0]->getMaxRepeat() == 5);
+    ctx.CHECK(ops[1]->getMinRepeat() == 3 && ops[1]->getMaxRepeat() == 3);
+    ctx.CHECK(ops[2]->getMinRepeat() == 1 && ops[2]->getMaxRepeat() == -1);
+    ctx.CHECK(ops[3]->getMinRepeat() == 0 && ops[3]->getMaxRepeat() == 0);
+    clearRegex(ops);
+
+    // A brace that doesn't start a count is an ordinary character.
+    ops = parseRegex("a{,2}x{");
+    ctx.CHECK(ops.size() == 7);
+    clearRegex(ops);
+    ctx.CHECK(Matcher(Regex("a{b}")).match("a{b}"));
+
+    ctx.CHECK(!hasGroups("a\\(b[(|)]c"));
+    ctx.CHECK(hasGroups("a|b") && hasGroups("(a)"));
+
+    unique_ptr<SyntaxNode> tree = parseSyntax("x(ab|c)*y");
+    ctx.CHECK(tree->kind == SyntaxNode::CONCAT &&
+              tree->children.size() == 3);
+    ctx.CHECK(tree->children[1]->kind == SyntaxNode::REPEAT &&
+              tree->children[1]->children[0]->kind ==
+              SyntaxNode::ALTERNATE);
+
+    bool allThrew = true;
+    for (const char *bad : {"(ab", "ab)", "a|(b", "a{3,2}", "(a){1001}",
+                            "a{2000}", "([ab)", "(a\\"}) {
+        try {
+            Regex regex(bad);
+            allThrew = false;
+        } catch (const invalid_argument &) {
+            // Expected
+        }
+    }
+    ctx.CHECK(allThrew);
+
+    // The flat parser leaves groups to parseSyntax().
+    bool threw = false;
+    try {
+        parseRegex("a|b");
+    } catch (const invalid_argument &) {
+        threw = true;
+    }
+    ctx.CHECK(threw);
+
+    ctx.result();
+
+    ctx.DESC("Both parsers reject the same malformed patterns");
+
+    // A pattern goes to one parser or the other depending on whether it has
+    // groups, so each must reject what the other does, with the same error.
+    bool sameErrors = true;
+    const char *malformed[] = {"[abc", "ab[", "[^", "a\\", "\\", "a{3,2}",
+                               "a{1001}", "[a(]b\\", "\\(["};
+    for (const char *p : malformed) {
+        string flatError, syntaxError;
+        try {
+            clearRegex(parseRegex(p));
+        } catch (const invalid_argument &e) {
+            flatError = e.what();
+        }
+        try {
+            parseSyntax(p);
+        } catch (const invalid_argument &e) {
+            syntaxError = e.what();
+        }
+
+        string regexError;
+        try {
+            Regex regex(p);
+        } catch (const invalid_argument &e) {
+            regexError = e.what();
+        }
+        if (flatError.empty() || flatError != syntaxError ||
+            regexError != flatError)
+            sameErrors = false;
+    }
+    ctx.CHECK(sameErrors);
+
+    // Malformed atoms before a group are found while looking for it.
+    threw = false;
+    try {
+        hasGroups("[ab(c)");
+    } catch (const invalid_argument &) {
+        threw = true;
+    }
+    ctx.CHECK(threw);
+
+    ctx.result();
+
+    ctx.DESC("Groups and alternation on the automaton engines");
+
+    for (Engine engine : {Engine::AUTO, Engine::PIKE_VM, Engine::DFA,
+                          Engine::BACKTRACK}) {
+        Regex regex("(cat|dog)s?|bird");
+        Matcher m(regex, engine);
+        Range r = m.find("a dogs and cats");
+        ctx.CHECK(r.start == 2 && r.end == 6);
+        r = m.find("the bird");
+        ctx.CHECK(r.start == 4 && r.end == 8);
+        ctx.CHECK(m.find("cow").start == -1);
+        ctx.CHECK(m.match("cats") && m.match("bird") && !m.match("birds"));
+
+        // Alternatives are preferred in order, but match() accepts the
+        // string if any of them covers it.
+        Regex ambiguous("(a|ab)(c|bcd)");
+        Matcher a(ambiguous, engine);
+        r = a.find("abcd");
+        ctx.CHECK(r.start == 0 && r.end == 4);
+        ctx.CHECK(Matcher(Regex("(a|ab)"), engine).match("ab"));
+        r = Matcher(Regex("(a|ab)"), engine).find("ab");
+        ctx.CHECK(r.start == 0 && r.end == 1);
+
+        Regex counted("x(ab){2,3}y");
+        Matcher c(counted, engine);
+        ctx.CHECK(!c.match("xaby") && c.match("xababy") &&
+                  c.match("xabababy") && !c.match("xababababy"));
+        r = c.find("xabxababababy xabababy");
+        ctx.CHECK(r.start == 14 && r.end == 22);
+    }
+    ctx.CHECK(Regex("a|b").getOperators().empty());
+    ctx.CHECK(Matcher(Regex("a|b"), Engine::BACKTRACK).find("b").end == 1);
+
+    ctx.result();
+
+    ctx.DESC("Counted repetition doesn't copy the repeated pattern");
+
+    Regex big("(ab|cd){1000}");
+    ctx.CHECK(big.getProgram().size() < 20);
+    ctx.CHECK(big.getProgram().numCounters() == 1);
+
+    string thousand;
+    for (int i = 0; i < 1000; i++)
+        thousand += i % 3 == 0 ? "cd" : "ab";
+    Matcher bigMatcher(big);
+    ctx.CHECK(bigMatcher.match(thousand));
+    ctx.CHECK(!bigMatcher.match(thousand + "ab"));
+    ctx.CHECK(!bigMatcher.match(thousand.substr(2)));
+    Range r = bigMatcher.find("x" + thousand + "abab");
+    ctx.CHECK(r.start == 1 && r.end == 2001);
+
+    ctx.CHECK(Regex("a{2,900}").getProgram().size() < 10);
+    r = Matcher(Regex("a{2,900}"), Engine::PIKE_VM).find(string(950, 'a'));
+    ctx.CHECK(r.start == 0 && r.end == 900);
+
+    // About a thousand threads at the same instructions, with different
+    // counter values, are live at once here.
+    Regex window("x.{0,1000}y");
+    string xs(1100, 'x');
+    for (Engine engine : {Engine::PIKE_VM, Engine::DFA}) {
+        Matcher m(window, engine);
+        ctx.CHECK(m.find(xs).start == -1);
+        r = m.find(xs + "y");
+        ctx.CHECK(r.start == 99 && r.end == 1101);
+    }
+
+    ctx.result();
+
+    ctx.DESC("Automaton engines agree with a naive matcher");
+
+    mt19937 rng(2025);
+    bool agree = true;
+    for (int trial = 0; trial < 300; trial++) {
+        string pattern = "(" + randomGroupPattern(rng, 1) + ")";
+        if (rng() % 2)
+            pattern += "|" + randomGroupPattern(rng, 1);
+        unique_ptr<SyntaxNode> syntax = parseSyntax(pattern);
+        if (hasEmptyRepeat(*syntax))
+            continue;
+
+        Regex regex(pattern);
+        Matcher pike(regex, Engine::PIKE_VM);
+        Matcher dfa(regex, Engine::DFA);
+        for (int t = 0; t < 10; t++) {
+            string s;
+            int length = rng() % 10;
+            for (int i = 0; i < length; i++)
+                s += "abcd"[rng() % 4];
+
+            Range expected(-1, -1);
+            for (int i = 0; i < length && expected.start == -1; i++) {
+                for (int end : syntaxEnds(*syntax, s, i)) {
+                    if (end > i) {
+                        expected = Range(i, end);
+                        break;
+                    }
+                }
+            }
+            vector<int> ends = syntaxEnds(*syntax, s, 0);
+            bool expectedMatch = length > 0 &&
+                find(ends.begin(), ends.end(), length) != ends.end();
+
+            for (Matcher *m : {&pike, &dfa}) {
+                Range r = m->find(s);
+                if (r.start != expected.start || r.end != expected.end ||
+                    m->match(s) != expectedMatch)
+                    agree = false;
+            }
+        }
+    }
+    ctx.CHECK(agree);
+
+    ctx.result();
+
+    ctx.DESC("Sets and streams of extended patterns");
+
+    RegexSet set({"(ab)+", "a(b|c){2}", "x|y", "[abc]{3,}"});
+    SetMatcher setMatcher(set);
+    ctx.CHECK(setMatcher.match("abab") == vector<int>({0, 3}));
+    ctx.CHECK(setMatcher.match("acb") == vector<int>({1, 3}));
+    ctx.CHECK(setMatcher.search("zzy") == vector<int>({2}));
+
+    Regex words("(ab|ba)+|c{2}");
+    Matcher matcher(words);
+    vector<StreamMatch> streamed;
+    StreamMatcher stream(words, [&](const StreamMatch &m) {
+        streamed.push_back(m);
+    });
+    bool streamAgrees = true;
+    for (const string &s : crossCheckSubjects()) {
+        vector<Range> expected;
+        for (const Range &r : matcher.findAll(s))
+            expected.push_back(r);
+
+        streamed.clear();
+        for (size_t i = 0; i < s.length(); i += 3)
+            stream.feed(s.data() + i, min<size_t>(3, s.length() - i));
+        stream.finish();
+
+        if (streamed.size() != expected.size()) {
+            streamAgrees = false;
+            continue;
+        }
+        for (size_t i = 0; i < expected.size(); i++) {
+            if (streamed[i].start != expected[i].start ||
+                streamed[i].end != expected[i].end)
+                streamAgrees = false;
+        }
+    }
+    ctx.CHECK(streamAgrees);
+
+    // Approximate matching only runs over operators.
+    threw = false;
+    try {
+        findApprox(words, "abab", 1);
+    } catch (const invalid_argument &) {
+        threw = true;
+    }
+    ctx.CHECK(threw);
+
+    ctx.result();
+}
+
+
+
+
+/*! Test matching slices of a larger buffer without copying them. */
+void test_string_views(TestContext &ctx) {
+    // The slices aren't null-terminated, and are surrounded by characters
+    // that would change the matches if an engine read past them.
+    const char buffer[] = "zzabbbcdzzxyzzabczz";
+    const string_view slice(buffer + 3, 4);          // "bbbc"
+    const string_view whole(buffer + 14, 3);         // "abc"
+
+    ctx.DESC("Matching string_views and raw buffers");
+
+    Regex regex("a?b+c");
+    Regex plain("abc");
+    for (Engine engine : {Engine::BACKTRACK, Engine::PIKE_VM, Engine::DFA,
+                          Engine::LITERAL, Engine::SHIFT_AND}) {
+        Matcher matcher(regex, engine);
+        Range r = matcher.find(slice);
+        ctx.CHECK(r.start == 0 && r.end == 4);
+        ctx.CHECK(matcher.match(slice));
+        ctx.CHECK(!matcher.match(buffer + 2, 4));
+        r = matcher.findAtIndex(buffer + 2, 3, 0);
+        ctx.CHECK(r.start == -1 && r.end == -1);
+
+        Matcher literal(plain, engine);
+        ctx.CHECK(literal.match(whole));
+        ctx.CHECK(!literal.match(buffer + 14, 2));
+        r = literal.find(buffer, 16);
+        ctx.CHECK(r.start == -1 && r.end == -1);
+        r = literal.find(buffer, 17);
+        ctx.CHECK(r.start == 14 && r.end == 17);
+    }
+
+    vector<RegexOperator *> ops = parseRegex("b+c");
+    Range r = find(ops, buffer + 2, 4);
+    ctx.CHECK(r.start == -1 && r.end == -1);
+    r = find(ops, slice);
+    ctx.CHECK(r.start == 0 && r.end == 4);
+    ctx.CHECK(match(ops, buffer + 3, 4, Engine::PIKE_VM));
+    clearRegex(ops);
+
+    ctx.CHECK(StaticRegex<STATIC_ABC>::match(whole));
+    ctx.CHECK(StaticRegex<STATIC_ABC>::find(buffer, 16).start == -1);
+
+    ctx.result();
+
+    ctx.DESC("Matching string_views doesn't copy them");
+
+    // The first pass warms up the matcher's scratch space and DFA states.
+    Matcher matcher(regex);
+    long before = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        before = numAllocations;
+        matcher.find(buffer, sizeof(buffer) - 1);
+        matcher.match(slice);
+        matcher.findAtIndex(slice, 1);
+    }
+    ctx.CHECK(numAllocations == before);
+
+    ctx.result();
+}
+
+
+/*! Test that reusing a Matcher doesn't allocate memory. */
+void test_matcher_allocations(TestContext &ctx) {
+    const Engine engines[] = {Engine::BACKTRACK, Engine::PIKE_VM, Engine::DFA,
+                              Engine::LITERAL, Engine::SHIFT_AND};
+    vector<string> subjects = crossCheckSubjects();
+
+    ctx.DESC("Reused Matcher makes no allocations");
+
+    for (const string &pattern : CROSS_CHECK_PATTERNS) {
+        Regex regex(pattern);
+        for (Engine engine : engines) {
+            Matcher matcher(regex, engine);
+
+            // The first pass warms up the matcher's scratch space.
+            for (const string &s : subjects) {
+                matcher.find(s);
+                matcher.match(s);
+                matcher.findAtIndex(s, 0);
+            }
+
+            long before = numAllocations;
+            for (const string &s : subjects) {
+                matcher.find(s);
+                matcher.match(s);
+                matcher.findAtIndex(s, 0);
+            }
+            ctx.CHECK(numAllocations == before);
+        }
+    }
+
+    ctx.result();
+}
+
+
 /*! This program is a simple test-suite for the Rational class. */
 int main() {
   
@@ -463,6 +2634,30 @@ int main() {
     test_plus(ctx);
     test_optional(ctx);
     test_complex_regex(ctx);
+    test_char_sets(ctx);
+    test_repetition_runs(ctx);
+    test_arena(ctx);
+    test_analysis(ctx);
+    test_prefilter(ctx);
+    test_literal(ctx);
+    test_static_regex(ctx);
+    test_bytecode(ctx);
+    test_pike_vm(ctx);
+    test_lazy_dfa(ctx);
+    test_shared_regex(ctx);
+    test_regex_cache(ctx);
+    test_string_views(ctx);
+    test_find_all(ctx);
+    test_stream(ctx);
+    test_grep(ctx);
+    test_parallel(ctx);
+    test_batch(ctx);
+    test_regex_set(ctx);
+    test_teddy(ctx);
+    test_shift_and(ctx);
+    test_approx(ctx);
+    test_extended_syntax(ctx);
+    test_matcher_allocations(ctx);
     
     // Return 0 if everything passed, nonzero if something failed.
     return !ctx.ok();